@@ -75,9 +75,9 @@ Copy-Item $build_location_x64/$project.dll -Destination $build_dir/plugin/obs-pl
 Copy-Item $build_location_x64/$project.pdb -Destination $build_dir/plugin/obs-plugins/32bit/
 
 echo("Fetching dependencies from $fftw")
-Copy-Item $fftw/64bit/libfftw3-3.dll -Destination $build_dir/plugin/obs-plugins/64bit/
+Copy-Item $fftw/64bit/libfftw3f-3.dll -Destination $build_dir/plugin/obs-plugins/64bit/
 if ($x86) {
-    Copy-Item $fftw/32bit/libfftw3-3.dll -Destination $build_dir/plugin/obs-plugins/32bit/
+    Copy-Item $fftw/32bit/libfftw3f-3.dll -Destination $build_dir/plugin/obs-plugins/32bit/
 }
 
 
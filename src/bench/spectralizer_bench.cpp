@@ -0,0 +1,162 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+/* Times every analysis stage over a matrix of settings, so regressions
+ * show up without having to run obs. Usage: spectralizer_bench [frames] */
+
+#include "../dsp/plan_cache.hpp"
+#include "../dsp/spectrum_analyzer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+enum stage { ST_PREPARE, ST_FFT, ST_BARS, ST_SMOOTH, ST_SCALE, ST_FALLOFF, ST_GRAVITY, ST_COUNT };
+
+const char *stage_names[ST_COUNT] = {"prepare", "fft", "bars", "smooth", "scale", "falloff", "gravity"};
+
+using bench_clock = std::chrono::steady_clock;
+
+/* A few sines plus noise, so bars, smoothing and auto scaling all have something to do */
+std::vector<float_stereo_sample> make_signal(uint32_t sample_rate, uint32_t frames)
+{
+	std::vector<float_stereo_sample> samples(frames);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+	const double two_pi = 2 * 3.14159265358979323846;
+
+	for (uint32_t i = 0; i < frames; i++) {
+		const double t = static_cast<double>(i) / sample_rate;
+		const double l = 0.4 * std::sin(two_pi * 110 * t) + 0.2 * std::sin(two_pi * 1760 * t);
+		const double r = 0.4 * std::sin(two_pi * 220 * t) + 0.2 * std::sin(two_pi * 7040 * t);
+		samples[i].l = static_cast<float>(l) + noise(rng);
+		samples[i].r = static_cast<float>(r) + noise(rng);
+	}
+	return samples;
+}
+
+void run(const dsp::analysis_settings &settings, uint32_t frames)
+{
+	dsp::spectrum_analyzer analyzer;
+	analyzer.configure(settings);
+
+	/* configure() asks for the plan, new sizes are then measured on the planner
+	 * thread. Wait for that, so the numbers neither come from the estimated plan
+	 * nor include the measuring. The analyzer picks up the new plan on its first transform */
+	dsp::plan_cache::wait_for_planner();
+	const int fft_size = static_cast<int>(std::max(settings.window_size, settings.sample_size));
+	const bool measured = dsp::plan_cache::is_measured(fft_size, settings.stereo ? 2 : 1);
+
+	/* Several blocks, so consecutive frames aren't identical */
+	const uint32_t blocks = 8;
+	const auto signal = make_signal(settings.sample_rate, settings.sample_size * blocks);
+
+	double total[ST_COUNT] = {};
+	const uint32_t warmup = frames / 10 + 1;
+
+	for (uint32_t frame = 0; frame < warmup + frames; frame++) {
+		const auto *buffer = &signal[(frame % blocks) * settings.sample_size];
+		bench_clock::time_point t[ST_COUNT + 1];
+
+		t[ST_PREPARE] = bench_clock::now();
+		analyzer.prepare_input(buffer);
+		t[ST_FFT] = bench_clock::now();
+		if (!analyzer.transform()) {
+			fprintf(stderr, "No fft plan for %u samples\n", settings.sample_size);
+			return;
+		}
+		t[ST_BARS] = bench_clock::now();
+		analyzer.create_bars();
+		t[ST_SMOOTH] = bench_clock::now();
+		analyzer.smooth();
+		t[ST_SCALE] = bench_clock::now();
+		analyzer.scale();
+		t[ST_FALLOFF] = bench_clock::now();
+		analyzer.update_falloff();
+		t[ST_GRAVITY] = bench_clock::now();
+		analyzer.apply_gravity();
+		t[ST_COUNT] = bench_clock::now();
+
+		if (frame < warmup)
+			continue;
+		for (int s = 0; s < ST_COUNT; s++)
+			total[s] += std::chrono::duration<double, std::nano>(t[s + 1] - t[s]).count();
+	}
+
+	static const char *smoothing_names[] = {"none", "monstercat", "sgs"};
+	double sum = 0;
+	printf("%6u %6u %6u %-6s %-10s %-8s", settings.sample_size, settings.window_size, settings.detail,
+		   settings.stereo ? "stereo" : "mono", smoothing_names[settings.smoothing], measured ? "measure" : "estimate");
+	for (int s = 0; s < ST_COUNT; s++) {
+		printf(" %9.0f", total[s] / frames);
+		sum += total[s];
+	}
+	printf(" %9.0f\n", sum / frames);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t frames = 2000;
+	if (argc > 1)
+		frames = static_cast<uint32_t>(std::max(1l, std::strtol(argv[1], nullptr, 10)));
+
+	dsp::plan_cache::init();
+
+	const uint32_t sample_sizes[] = {735, 1470, 2048, 4096};
+	const uint32_t window_sizes[] = {0, 4096}; /* 0 is just the current block */
+	const uint32_t details[] = {32, 256, 2048};
+	const smooting_mode smoothing_modes[] = {SM_NONE, SM_MONSTERCAT, SM_SGS};
+
+	printf("ns/frame, %u frames per row\n", frames);
+	printf("%6s %6s %6s %-6s %-10s %-8s", "size", "window", "detail", "chans", "smoothing", "plan");
+	for (const auto *name : stage_names)
+		printf(" %9s", name);
+	printf(" %9s\n", "total");
+
+	for (const auto sample_size : sample_sizes) {
+		for (const auto window_size : window_sizes) {
+			if (window_size && window_size <= sample_size)
+				continue;
+			for (const auto detail : details) {
+				for (int stereo = 0; stereo < 2; stereo++) {
+					for (const auto smoothing : smoothing_modes) {
+						dsp::analysis_settings settings;
+						settings.sample_size = sample_size;
+						settings.window_size = window_size;
+						settings.window = window_size ? WF_HANN : WF_NONE;
+						settings.detail = detail;
+						settings.stereo = stereo != 0;
+						settings.smoothing = smoothing;
+						settings.sgs_points = 9;
+						run(settings, frames);
+					}
+				}
+			}
+		}
+	}
+
+	dsp::plan_cache::clear();
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <cstdint>
+
+/* Everything the analysis needs that isn't tied to libobs, so the
+ * dsp library can be built and benchmarked without it */
+
+#define DEAD_BAR_OFFSET 5 /* The last five bars seem to always be silent, so we cut them off */
+
+/* clang-format off */
+
+enum smooting_mode
+{
+    SM_NONE = 0,
+    SM_MONSTERCAT,
+    SM_SGS
+};
+
+enum window_function
+{
+    WF_NONE = 0,
+    WF_HANN,
+    WF_BLACKMAN
+};
+
+enum channel_mode
+{
+    CM_LEFT = 0,
+    CM_RIGHT,
+    CM_BOTH
+};
+
+struct stereo_sample_frame
+{
+    int16_t l, r;
+};
+
+using pcm_stereo_sample = struct stereo_sample_frame;
+
+struct stereo_float_frame
+{
+    float l, r;
+};
+
+using float_stereo_sample = struct stereo_float_frame;
+
+namespace constants {
+    static const constexpr int auto_scale_span 					= 30;
+    static const constexpr double auto_scaling_reset_window		= 0.1;
+    static const constexpr double auto_scaling_erase_percent 	= 0.75;
+    /* Amount of deviation needed between short term and long
+     * term moving max height averages to trigger an autoscaling reset */
+    static const constexpr double deviation_amount_to_reset 	= 1.0;
+    /* Float samples are scaled up to the int16 range before the fft */
+    static const constexpr double sample_scale					= UINT16_MAX / 2;
+    /* dB the level has to rise above the silence threshold to count as audio again */
+    static const constexpr double silence_hysteresis			= 6.0;
+}
+
+/* clang-format on */
@@ -0,0 +1,35 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <fftw3.h>
+#include <vector>
+
+/* The analysis runs in single precision with fftw3f, unless the plugin is
+ * built with SPECTRALIZER_DOUBLE_PRECISION, which uses fftw3 instead */
+#ifdef SPECTRALIZER_DOUBLE_PRECISION
+#define FFTW(name) fftw_##name
+using real_t = double;
+#else
+#define FFTW(name) fftwf_##name
+using real_t = float;
+#endif
+
+using fft_complex = FFTW(complex);
+using fft_plan = FFTW(plan);
+using realv = std::vector<real_t>;
@@ -0,0 +1,368 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "kernels.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/* gcc and clang only allow intrinsics in functions built for that instruction set,
+ * msvc allows them anywhere */
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace dsp {
+namespace kernels {
+
+enum instruction_set_level { IS_SCALAR, IS_SSE2, IS_AVX2 };
+
+static instruction_set_level detect()
+{
+#ifdef KERNELS_X86
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	/* The os also has to save the ymm registers */
+	if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+			return IS_AVX2;
+	}
+	return sse2 ? IS_SSE2 : IS_SCALAR;
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return IS_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return IS_SSE2;
+#endif
+#endif
+	return IS_SCALAR;
+}
+
+static instruction_set_level level()
+{
+	static const instruction_set_level l = detect();
+	return l;
+}
+
+const char *instruction_set()
+{
+	switch (level()) {
+	case IS_AVX2:
+		return "AVX2";
+	case IS_SSE2:
+		return "SSE2";
+	default:
+		return "scalar";
+	}
+}
+
+/* Magnitudes, fft_complex is {re, im} so the input is read as count * 2 reals */
+
+static void magnitudes_scalar(const real_t *in, real_t *out, size_t start, size_t count)
+{
+	for (size_t i = start; i < count; i++) {
+		const real_t re = in[2 * i], im = in[2 * i + 1];
+		out[i] = std::sqrt(re * re + im * im);
+	}
+}
+
+#ifdef KERNELS_X86
+#ifdef SPECTRALIZER_DOUBLE_PRECISION
+TARGET_SSE2 static void magnitudes_sse2(const double *in, double *out, size_t count)
+{
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const __m128d a = _mm_loadu_pd(in + 2 * i);     /* re0 im0 */
+		const __m128d b = _mm_loadu_pd(in + 2 * i + 2); /* re1 im1 */
+		const __m128d re = _mm_unpacklo_pd(a, b);
+		const __m128d im = _mm_unpackhi_pd(a, b);
+		_mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(re, re), _mm_mul_pd(im, im))));
+	}
+	magnitudes_scalar(in, out, i, count);
+}
+
+TARGET_AVX2 static void magnitudes_avx2(const double *in, double *out, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m256d a = _mm256_loadu_pd(in + 2 * i);     /* re0 im0 re1 im1 */
+		const __m256d b = _mm256_loadu_pd(in + 2 * i + 4); /* re2 im2 re3 im3 */
+		/* unpack works per 128 bit lane, so this yields bins 0 2 1 3 */
+		const __m256d re = _mm256_unpacklo_pd(a, b);
+		const __m256d im = _mm256_unpackhi_pd(a, b);
+		const __m256d m = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(re, re), _mm256_mul_pd(im, im)));
+		_mm256_storeu_pd(out + i, _mm256_permute4x64_pd(m, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	magnitudes_scalar(in, out, i, count);
+}
+#else
+TARGET_SSE2 static void magnitudes_sse2(const float *in, float *out, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 a = _mm_loadu_ps(in + 2 * i);     /* re0 im0 re1 im1 */
+		const __m128 b = _mm_loadu_ps(in + 2 * i + 4); /* re2 im2 re3 im3 */
+		const __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+	}
+	magnitudes_scalar(in, out, i, count);
+}
+
+TARGET_AVX2 static void magnitudes_avx2(const float *in, float *out, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 a = _mm256_loadu_ps(in + 2 * i);     /* bins 0-3 */
+		const __m256 b = _mm256_loadu_ps(in + 2 * i + 8); /* bins 4-7 */
+		/* shuffle works per 128 bit lane, so this yields bins 0 1 4 5 2 3 6 7 */
+		const __m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m256 im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		const __m256 m = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im)));
+		const __m256d ordered = _mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_ps(out + i, _mm256_castpd_ps(ordered));
+	}
+	magnitudes_scalar(in, out, i, count);
+}
+#endif
+#endif
+
+/* Deinterleaving, frames are {l, r} so the input is read as count * 2 floats.
+ * The vector versions keep one partial sum per lane and add them up at the end */
+
+struct sample_level {
+	float peak = 0.f;
+	double sum_squares = 0.0;
+};
+
+static void deinterleave_scalar(const float *in, size_t start, size_t count, real_t scale, const real_t *window,
+								real_t *left, real_t *right, sample_level *l, sample_level *r)
+{
+	for (size_t i = start; i < count; i++) {
+		const float sl = in[2 * i], sr = in[2 * i + 1];
+		const real_t w = window ? window[i] : 1;
+
+		left[i] = static_cast<real_t>(sl) * scale * w;
+		if (right)
+			right[i] = static_cast<real_t>(sr) * scale * w;
+
+		l->peak = std::max(l->peak, std::abs(sl));
+		r->peak = std::max(r->peak, std::abs(sr));
+		l->sum_squares += sl * sl;
+		r->sum_squares += sr * sr;
+	}
+}
+
+#ifdef KERNELS_X86
+#ifdef SPECTRALIZER_DOUBLE_PRECISION
+TARGET_SSE2 static inline void store_sse2(double *out, __m128 v, double scale, const double *window)
+{
+	const __m128d s = _mm_set1_pd(scale);
+	__m128d lo = _mm_mul_pd(_mm_cvtps_pd(v), s);
+	__m128d hi = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), s);
+	if (window) {
+		lo = _mm_mul_pd(lo, _mm_loadu_pd(window));
+		hi = _mm_mul_pd(hi, _mm_loadu_pd(window + 2));
+	}
+	_mm_storeu_pd(out, lo);
+	_mm_storeu_pd(out + 2, hi);
+}
+
+TARGET_AVX2 static inline void store_avx2(double *out, __m256 v, double scale, const double *window)
+{
+	const __m256d s = _mm256_set1_pd(scale);
+	__m256d lo = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), s);
+	__m256d hi = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), s);
+	if (window) {
+		lo = _mm256_mul_pd(lo, _mm256_loadu_pd(window));
+		hi = _mm256_mul_pd(hi, _mm256_loadu_pd(window + 4));
+	}
+	_mm256_storeu_pd(out, lo);
+	_mm256_storeu_pd(out + 4, hi);
+}
+#else
+TARGET_SSE2 static inline void store_sse2(float *out, __m128 v, float scale, const float *window)
+{
+	v = _mm_mul_ps(v, _mm_set1_ps(scale));
+	if (window)
+		v = _mm_mul_ps(v, _mm_loadu_ps(window));
+	_mm_storeu_ps(out, v);
+}
+
+TARGET_AVX2 static inline void store_avx2(float *out, __m256 v, float scale, const float *window)
+{
+	v = _mm256_mul_ps(v, _mm256_set1_ps(scale));
+	if (window)
+		v = _mm256_mul_ps(v, _mm256_loadu_ps(window));
+	_mm256_storeu_ps(out, v);
+}
+#endif
+
+TARGET_SSE2 static void deinterleave_sse2(const float *in, size_t count, real_t scale, const real_t *window,
+										  real_t *left, real_t *right, sample_level *l, sample_level *r)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 peak_l = _mm_setzero_ps(), peak_r = _mm_setzero_ps();
+	__m128 sum_l = _mm_setzero_ps(), sum_r = _mm_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		const __m128 a = _mm_loadu_ps(in + 2 * i);     /* l0 r0 l1 r1 */
+		const __m128 b = _mm_loadu_ps(in + 2 * i + 4); /* l2 r2 l3 r3 */
+		const __m128 vl = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 vr = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		const real_t *w = window ? window + i : nullptr;
+
+		store_sse2(left + i, vl, scale, w);
+		if (right)
+			store_sse2(right + i, vr, scale, w);
+
+		peak_l = _mm_max_ps(peak_l, _mm_and_ps(vl, abs_mask));
+		peak_r = _mm_max_ps(peak_r, _mm_and_ps(vr, abs_mask));
+		sum_l = _mm_add_ps(sum_l, _mm_mul_ps(vl, vl));
+		sum_r = _mm_add_ps(sum_r, _mm_mul_ps(vr, vr));
+	}
+
+	alignas(16) float pl[4], pr[4], sl[4], sr[4];
+	_mm_store_ps(pl, peak_l);
+	_mm_store_ps(pr, peak_r);
+	_mm_store_ps(sl, sum_l);
+	_mm_store_ps(sr, sum_r);
+	for (int k = 0; k < 4; k++) {
+		l->peak = std::max(l->peak, pl[k]);
+		r->peak = std::max(r->peak, pr[k]);
+		l->sum_squares += sl[k];
+		r->sum_squares += sr[k];
+	}
+	deinterleave_scalar(in, i, count, scale, window, left, right, l, r);
+}
+
+TARGET_AVX2 static void deinterleave_avx2(const float *in, size_t count, real_t scale, const real_t *window,
+										  real_t *left, real_t *right, sample_level *l, sample_level *r)
+{
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 peak_l = _mm256_setzero_ps(), peak_r = _mm256_setzero_ps();
+	__m256 sum_l = _mm256_setzero_ps(), sum_r = _mm256_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		const __m256 a = _mm256_loadu_ps(in + 2 * i);     /* frames 0-3 */
+		const __m256 b = _mm256_loadu_ps(in + 2 * i + 8); /* frames 4-7 */
+		/* shuffle works per 128 bit lane, so this yields frames 0 1 4 5 2 3 6 7 */
+		const __m256 sl = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m256 sr = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		const __m256 vl =
+			_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sl), _MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 vr =
+			_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sr), _MM_SHUFFLE(3, 1, 2, 0)));
+		const real_t *w = window ? window + i : nullptr;
+
+		store_avx2(left + i, vl, scale, w);
+		if (right)
+			store_avx2(right + i, vr, scale, w);
+
+		peak_l = _mm256_max_ps(peak_l, _mm256_and_ps(vl, abs_mask));
+		peak_r = _mm256_max_ps(peak_r, _mm256_and_ps(vr, abs_mask));
+		sum_l = _mm256_add_ps(sum_l, _mm256_mul_ps(vl, vl));
+		sum_r = _mm256_add_ps(sum_r, _mm256_mul_ps(vr, vr));
+	}
+
+	alignas(32) float pl[8], pr[8], sl[8], sr[8];
+	_mm256_store_ps(pl, peak_l);
+	_mm256_store_ps(pr, peak_r);
+	_mm256_store_ps(sl, sum_l);
+	_mm256_store_ps(sr, sum_r);
+	for (int k = 0; k < 8; k++) {
+		l->peak = std::max(l->peak, pl[k]);
+		r->peak = std::max(r->peak, pr[k]);
+		l->sum_squares += sl[k];
+		r->sum_squares += sr[k];
+	}
+	deinterleave_scalar(in, i, count, scale, window, left, right, l, r);
+}
+#endif
+
+void deinterleave(const float_stereo_sample *in, size_t count, real_t scale, const real_t *window, real_t *left,
+				  real_t *right, channel_stats *left_stats, channel_stats *right_stats)
+{
+	const auto *values = reinterpret_cast<const float *>(in);
+	sample_level l, r;
+
+	switch (level()) {
+#ifdef KERNELS_X86
+	case IS_AVX2:
+		deinterleave_avx2(values, count, scale, window, left, right, &l, &r);
+		break;
+	case IS_SSE2:
+		deinterleave_sse2(values, count, scale, window, left, right, &l, &r);
+		break;
+#endif
+	default:
+		deinterleave_scalar(values, 0, count, scale, window, left, right, &l, &r);
+	}
+
+	if (left_stats) {
+		left_stats->peak = l.peak;
+		left_stats->rms = count ? std::sqrt(l.sum_squares / count) : 0.0;
+	}
+	if (right_stats) {
+		right_stats->peak = r.peak;
+		right_stats->rms = count ? std::sqrt(r.sum_squares / count) : 0.0;
+	}
+}
+
+void magnitudes(const fft_complex *in, real_t *out, size_t count)
+{
+	const auto *values = reinterpret_cast<const real_t *>(in);
+
+	switch (level()) {
+#ifdef KERNELS_X86
+	case IS_AVX2:
+		magnitudes_avx2(values, out, count);
+		break;
+	case IS_SSE2:
+		magnitudes_sse2(values, out, count);
+		break;
+#endif
+	default:
+		magnitudes_scalar(values, out, 0, count);
+	}
+}
+
+}
+}
@@ -0,0 +1,49 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "common.hpp"
+#include "fft_types.hpp"
+#include <cstddef>
+
+namespace dsp {
+namespace kernels {
+
+/* The hot loops of the analysis. Each one has a scalar, SSE2 and AVX2
+ * version, the best one the cpu supports is picked on first use */
+
+/* out[i] = |in[i]| for count bins */
+void magnitudes(const fft_complex *in, real_t *out, size_t count);
+
+/* Level of the unscaled samples, both in [0, 1] */
+struct channel_stats {
+	float peak;
+	double rms;
+};
+
+/* Splits count interleaved frames into left and right (right can be null if it
+ * isn't needed), multiplying every sample with scale and with window[i] if
+ * window isn't null. Peak and RMS of the input are written to the stats */
+void deinterleave(const float_stereo_sample *in, size_t count, real_t scale, const real_t *window, real_t *left,
+				  real_t *right, channel_stats *left_stats, channel_stats *right_stats);
+
+/* Name of the instruction set the kernels run with, for logging */
+const char *instruction_set();
+
+}
+}
@@ -0,0 +1,74 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "monstercat.hpp"
+
+namespace dsp {
+
+void monstercat_filter(realv *bars, const realv &weights, real_t min_height, realv *sources)
+{
+	const auto bars_length = bars->size();
+	auto &b = *bars;
+
+	// apply monstercat sytle smoothing
+	// Every bar that isn't below the minimum height pulls all other bars up to
+	// at least its height divided by factor^distance. Since all bars decay with
+	// the same factor, the bar that reaches furthest in one direction is always
+	// the most recent one that wasn't pulled up by a bar before it, so one sweep
+	// in each direction is enough instead of comparing every pair of bars.
+	// sources keeps the height each bar had when it started pulling others
+	// up, zero if it didn't.
+	sources->assign(bars_length, 0);
+	auto &src = *sources;
+
+	// Left to right: bars are processed in order, so this also decides which
+	// bars fall below the minimum height. Since this type of smoothing smoothes
+	// the bars around it, doesn't make sense to smooth the first value so skip it.
+	size_t source = 0;
+	for (size_t i = 1; i < bars_length; ++i) {
+		if (source) {
+			const auto weighted_value = src[source] / weights[i - source];
+			if (b[i] < weighted_value)
+				b[i] = weighted_value;
+		}
+
+		if (b[i] < min_height) {
+			b[i] = min_height;
+		} else {
+			src[i] = b[i];
+			source = i;
+		}
+	}
+
+	// Right to left: pull bars up to the sources on their right
+	source = 0;
+	for (size_t i = bars_length; i-- > 0;) {
+		if (source) {
+			const auto weighted_value = src[source] / weights[source - i];
+			if (b[i] < weighted_value)
+				b[i] = weighted_value;
+
+			if (src[i] > 0 && src[i] >= weighted_value)
+				source = i;
+		} else if (src[i] > 0) {
+			source = i;
+		}
+	}
+}
+
+}
@@ -0,0 +1,30 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "fft_types.hpp"
+
+namespace dsp {
+
+/* Monstercat style smoothing: every bar that isn't below min_height pulls all
+ * other bars up to at least its height divided by factor^distance.
+ * weights[i] has to be factor^i for every bar, sources is scratch space.
+ * Doesn't depend on obs, so it can be tested against the original version */
+void monstercat_filter(realv *bars, const realv &weights, real_t min_height, realv *sources);
+
+}
@@ -0,0 +1,208 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "plan_cache.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+/* Flags used for plans built by the background planner */
+#define MEASURED_PLAN_FLAGS FFTW_MEASURE
+
+namespace dsp {
+namespace plan_cache {
+
+struct plan_key {
+	int size, channels;
+	int in_alignment, out_alignment;
+
+	bool operator<(const plan_key &o) const
+	{
+		return std::tie(size, channels, in_alignment, out_alignment) <
+			   std::tie(o.size, o.channels, o.in_alignment, o.out_alignment);
+	}
+};
+
+static std::mutex cache_mutex;
+static std::map<plan_key, fft_plan> plans;
+/* Estimated plans that were replaced, a visualizer might still be running
+ * them so they're only destroyed in clear() */
+static std::vector<fft_plan> retired_plans;
+/* Plans in the cache that the planner didn't measure (yet) */
+static std::set<fft_plan> estimated_plans;
+static std::atomic<uint32_t> plan_generation(0);
+
+/* Background planner */
+static std::thread planner;
+static std::condition_variable planner_cv;
+static std::deque<plan_key> planner_jobs;
+static bool planner_stop = false, planner_busy = false;
+static std::condition_variable planner_idle_cv;
+
+static fft_plan create_plan(const plan_key &key, real_t *in, fft_complex *out, unsigned flags)
+{
+	int size = key.size;
+	int bins = size / 2 + 1;
+	return FFTW(plan_many_dft_r2c)(1, &size, key.channels, in, nullptr, 1, size, out, nullptr, 1, bins, flags);
+}
+
+static void planner_thread()
+{
+	std::unique_lock<std::mutex> lock(cache_mutex);
+
+	for (;;) {
+		planner_cv.wait(lock, [] { return planner_stop || !planner_jobs.empty(); });
+		if (planner_stop)
+			break;
+
+		plan_key key = planner_jobs.front();
+		planner_jobs.pop_front();
+		planner_busy = true;
+		lock.unlock();
+
+		/* Measuring overwrites the arrays, so it gets its own */
+		auto *in = FFTW(alloc_real)(static_cast<size_t>(key.size) * key.channels);
+		auto *out = FFTW(alloc_complex)(static_cast<size_t>(key.size / 2 + 1) * key.channels);
+		fft_plan plan = create_plan(key, in, out, MEASURED_PLAN_FLAGS);
+		FFTW(free)(in);
+		FFTW(free)(out);
+
+		lock.lock();
+		if (plan) {
+			auto it = plans.find(key);
+			if (it != plans.end()) {
+				retired_plans.push_back(it->second);
+				estimated_plans.erase(it->second);
+			}
+			plans[key] = plan;
+			++plan_generation;
+		}
+		planner_busy = false;
+		planner_idle_cv.notify_all();
+	}
+
+	planner_busy = false;
+	planner_idle_cv.notify_all();
+}
+
+void init()
+{
+	/* The background planner runs alongside the video thread */
+	FFTW(make_planner_thread_safe)();
+}
+
+fft_plan get_r2c(int size, int channels, real_t *in, fft_complex *out)
+{
+	if (size < 1 || channels < 1 || !in || !out)
+		return nullptr;
+
+	plan_key key = {size, channels, FFTW(alignment_of)(in), FFTW(alignment_of)(reinterpret_cast<real_t *>(out))};
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	auto it = plans.find(key);
+	if (it != plans.end())
+		return it->second;
+
+	/* Neither of these touch the arrays, so it's safe to plan on live buffers */
+	fft_plan plan = create_plan(key, in, out, MEASURED_PLAN_FLAGS | FFTW_WISDOM_ONLY);
+	if (!plan) {
+		plan = create_plan(key, in, out, FFTW_ESTIMATE);
+		if (plan)
+			estimated_plans.insert(plan);
+
+		/* The planner can only measure on its own buffers if they line
+		 * up with the ones the plan will be used with */
+		if (plan && key.in_alignment == 0 && key.out_alignment == 0 && !planner_stop) {
+			if (!planner.joinable())
+				planner = std::thread(planner_thread);
+			planner_jobs.push_back(key);
+			planner_cv.notify_one();
+		}
+	}
+
+	if (plan)
+		plans[key] = plan;
+	return plan;
+}
+
+uint32_t generation()
+{
+	return plan_generation.load();
+}
+
+void wait_for_planner()
+{
+	std::unique_lock<std::mutex> lock(cache_mutex);
+	planner_idle_cv.wait(lock, [] { return planner_stop || (planner_jobs.empty() && !planner_busy); });
+}
+
+bool is_measured(int size, int channels)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	auto it = plans.find(plan_key{size, channels, 0, 0});
+	return it != plans.end() && !estimated_plans.count(it->second);
+}
+
+static void stop_planner()
+{
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		planner_stop = true;
+		planner_jobs.clear();
+	}
+	planner_cv.notify_one();
+
+	if (planner.joinable())
+		planner.join();
+}
+
+bool import_wisdom(const char *file)
+{
+	return FFTW(import_wisdom_from_filename)(file) != 0;
+}
+
+bool export_wisdom(const char *file)
+{
+	/* Let the planner finish, so its wisdom makes it into the file */
+	stop_planner();
+	return FFTW(export_wisdom_to_filename)(file) != 0;
+}
+
+void clear()
+{
+	stop_planner();
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	for (auto &p : plans)
+		FFTW(destroy_plan)(p.second);
+	for (auto &p : retired_plans)
+		FFTW(destroy_plan)(p);
+	plans.clear();
+	retired_plans.clear();
+	estimated_plans.clear();
+	FFTW(cleanup)();
+}
+
+}
+}
@@ -0,0 +1,56 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <cstdint>
+#include "fft_types.hpp"
+
+namespace dsp {
+namespace plan_cache {
+
+/* Has to be called before any plan is requested */
+void init();
+
+/* Returns a real to complex plan for `channels` transforms of `size` samples each,
+ * laid out one after another in `in` and `out`. Plans are created once and shared
+ * by all visualizers, so they must be run with fftw(f)_execute_dft_r2c on buffers that
+ * have the same alignment as the ones passed in here (use fftw_alloc_*).
+ * Unknown sizes get an estimated plan right away, a measured one is then
+ * built in the background and replaces it once it's done */
+fft_plan get_r2c(int size, int channels, real_t *in, fft_complex *out);
+
+/* Increases every time a measured plan replaces an estimated one,
+ * plans should be fetched again once this changes */
+uint32_t generation();
+
+/* Blocks until the background planner has measured every plan it was asked for */
+void wait_for_planner();
+
+/* Whether the cached plan for fftw(f)_alloc_* buffers of this size was
+ * measured (or came from wisdom), false for estimated or unknown plans */
+bool is_measured(int size, int channels);
+
+bool import_wisdom(const char *file);
+bool export_wisdom(const char *file);
+
+/* Waits for the background planner and destroys all cached plans,
+ * only call this once no visualizer is left */
+void clear();
+
+}
+}
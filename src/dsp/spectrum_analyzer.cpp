@@ -0,0 +1,414 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "spectrum_analyzer.hpp"
+#include "kernels.hpp"
+#include "monstercat.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace dsp {
+spectrum_analyzer::spectrum_analyzer()
+	: m_last_bar_count(0),
+	  m_spectrum_size(0),
+	  m_spectrum_results(0),
+	  m_bins_used(0),
+	  m_silent(false),
+	  m_silence_level_low(0),
+	  m_silence_level_high(0)
+{
+}
+
+spectrum_analyzer::~spectrum_analyzer() {}
+
+void spectrum_analyzer::configure(const analysis_settings &settings)
+{
+	/* Only derived state that depends on a changed field is rebuilt, cosmetic
+	 * changes keep the history, the auto scaling window and the bar mapping */
+	if (settings.mcat_smoothing_factor != m_settings.mcat_smoothing_factor)
+		m_monstercat_smoothing_weights.clear(); /* Force recomputing of smoothing */
+	if (settings.detail != m_settings.detail || settings.sample_rate != m_settings.sample_rate ||
+		settings.low_cutoff_freq != m_settings.low_cutoff_freq ||
+		settings.high_cutoff_freq != m_settings.high_cutoff_freq)
+		m_last_bar_count = 0; /* and cutoff frequencies */
+
+	m_settings = settings;
+	m_silence_level_low = std::pow(10.0, m_settings.silence_threshold / 20.0);
+	m_silence_level_high = std::pow(10.0, (m_settings.silence_threshold + constants::silence_hysteresis) / 20.0);
+	m_transform.configure(m_settings.to_transform());
+}
+
+bool spectrum_analyzer::process()
+{
+	if (!transform())
+		return false;
+	create_bars();
+	process_bars();
+	return true;
+}
+
+void spectrum_analyzer::process_bars()
+{
+	smooth();
+	scale();
+	update_falloff();
+	apply_gravity();
+}
+
+bool spectrum_analyzer::prepare_input(const float_stereo_sample *buffer)
+{
+	if (!m_transform.prepare_input(buffer))
+		return true;
+	return check_silence(m_transform);
+}
+
+bool spectrum_analyzer::check_silence(const spectrum_transform &spectrum)
+{
+	/* Mono only looks at the left channel */
+	const auto rms = m_settings.stereo ? std::max(spectrum.level_left(), spectrum.level_right())
+									   : spectrum.level_left();
+
+	/* Once silent the level has to rise a bit above the threshold again,
+	 * so audio hovering around it doesn't keep toggling the sleep state */
+	m_silent = rms < (m_silent ? m_silence_level_high : m_silence_level_low);
+	return m_silent;
+}
+
+bool spectrum_analyzer::transform()
+{
+	return m_transform.transform();
+}
+
+void spectrum_analyzer::create_bars()
+{
+	create_bars(m_transform);
+}
+
+void spectrum_analyzer::create_bars(const spectrum_transform &spectrum)
+{
+	const auto number_of_bars = m_settings.detail + DEAD_BAR_OFFSET;
+
+	// cut off frequencies only have to be re-calculated if number of bars
+	// or the fft size change
+	if (m_last_bar_count != number_of_bars || m_spectrum_size != spectrum.size()) {
+		m_spectrum_size = spectrum.size();
+		m_spectrum_results = spectrum.results();
+		recalculate_cutoff_frequencies(number_of_bars, &m_low_cutoff_frequencies, &m_high_cutoff_frequencies,
+									   &m_frequency_constants_per_bin);
+		build_bar_mapping(number_of_bars);
+		m_last_bar_count = number_of_bars;
+	}
+
+	// Separate the frequency spectrum into bars, the number of bars is based on
+	// screen width
+	generate_bars(spectrum.output_left(), &m_bars_left_new);
+	if (m_settings.stereo)
+		generate_bars(spectrum.output_right(), &m_bars_right_new);
+}
+
+void spectrum_analyzer::smooth()
+{
+	smooth_bars(&m_bars_left_new);
+	if (m_settings.stereo)
+		smooth_bars(&m_bars_right_new);
+}
+
+void spectrum_analyzer::scale()
+{
+	auto height = m_settings.height;
+	if (m_settings.stereo)
+		height /= 2;
+
+	scale_bars(height, &m_bars_left_new);
+	if (m_settings.stereo)
+		scale_bars(height, &m_bars_right_new);
+}
+
+void spectrum_analyzer::update_falloff()
+{
+	// falloff, save values for next falloff run
+	apply_falloff(m_bars_left_new, &m_bars_falloff_left);
+	if (m_settings.stereo)
+		apply_falloff(m_bars_right_new, &m_bars_falloff_right);
+}
+
+void spectrum_analyzer::apply_gravity()
+{
+	blend_bars(m_bars_left_new, &m_bars_left);
+	if (m_settings.stereo)
+		blend_bars(m_bars_right_new, &m_bars_right);
+}
+
+void spectrum_analyzer::blend_bars(const realv &bars_new, realv *bars) const
+{
+	const auto gravity = static_cast<real_t>(m_settings.gravity);
+	const auto grav = 1 - gravity;
+
+	bars->resize(bars_new.size(), 0);
+	for (size_t i = 0; i < bars->size(); i++)
+		(*bars)[i] = (*bars)[i] * gravity + bars_new[i] * grav;
+}
+
+void spectrum_analyzer::smooth_bars(realv *bars)
+{
+	switch (m_settings.smoothing) {
+	case SM_MONSTERCAT:
+		monstercat_smoothing(bars);
+		break;
+	case SM_SGS:
+		sgs_smoothing(bars);
+		break;
+	default:;
+	}
+}
+
+void spectrum_analyzer::sgs_smoothing(realv *bars)
+{
+	const auto smoothing_passes = m_settings.sgs_passes;
+	const auto pivot = static_cast<size_t>(m_settings.sgs_points / 2);
+	const auto window = 2 * pivot + 1;
+	const auto bars_length = bars->size();
+
+	// Bars within pivot of either end are never averaged, so there's
+	// nothing to do if no bar has a full window around it
+	if (smoothing_passes == 0 || pivot == 0 || bars_length < window)
+		return;
+
+	// Each pass reads from one buffer and writes the other, the scratch
+	// buffer keeps its capacity so this doesn't allocate after the first frame
+	m_sgs_scratch.resize(bars_length);
+	auto *src = bars;
+	auto *dst = &m_sgs_scratch;
+	const auto smoothing_constant = 1.0 / window;
+
+	for (auto pass = 0u; pass < smoothing_passes; ++pass) {
+		auto &in = *src;
+		auto &out = *dst;
+
+		for (size_t i = 0; i < pivot; ++i) {
+			out[i] = in[i];
+			out[bars_length - i - 1] = in[bars_length - i - 1];
+		}
+
+		// Sliding window: add the bar entering on the right and drop the one
+		// leaving on the left instead of summing the whole window per bar
+		auto sum = 0.0;
+		for (size_t j = 0; j < window; ++j)
+			sum += in[j];
+
+		for (auto i = pivot;; ++i) {
+			out[i] = static_cast<real_t>(sum * smoothing_constant);
+			if (i + pivot + 1 >= bars_length)
+				break;
+			sum += in[i + pivot + 1] - in[i - pivot];
+		}
+
+		std::swap(src, dst);
+	}
+
+	// After an odd number of passes the result is in the scratch buffer
+	if (src != bars)
+		std::copy(src->begin(), src->end(), bars->begin());
+}
+
+void spectrum_analyzer::monstercat_smoothing(realv *bars)
+{
+	// re-compute weights if needed, this is a performance tweak to computer the
+	// smoothing considerably faster
+	if (m_monstercat_smoothing_weights.size() != bars->size()) {
+		m_monstercat_smoothing_weights.resize(bars->size());
+		for (auto i = 0u; i < bars->size(); ++i) {
+			m_monstercat_smoothing_weights[i] = std::pow(m_settings.mcat_smoothing_factor, i);
+		}
+	}
+
+	monstercat_filter(bars, m_monstercat_smoothing_weights, static_cast<real_t>(m_settings.bar_min_height),
+					  &m_monstercat_sources);
+}
+
+void spectrum_analyzer::apply_falloff(const realv &bars, realv *falloff_bars) const
+{
+	// Screen size has change which means previous falloff values are not valid
+	if (falloff_bars->size() != bars.size()) {
+		*falloff_bars = bars;
+		return;
+	}
+
+	const auto falloff_weight = static_cast<real_t>(m_settings.falloff_weight);
+	for (auto i = 0u; i < bars.size(); ++i) {
+		// falloff should always by at least one
+		auto falloff_value = std::min((*falloff_bars)[i] * falloff_weight, (*falloff_bars)[i] - 1);
+
+		(*falloff_bars)[i] = std::max(falloff_value, bars[i]);
+	}
+}
+
+void spectrum_analyzer::calculate_moving_average_and_std_dev(double new_value, util::moving_window *old_values,
+															   double *moving_average, double *std_dev) const
+{
+	old_values->push(new_value);
+	*moving_average = old_values->mean();
+	*std_dev = old_values->std_dev();
+}
+
+void spectrum_analyzer::scale_bars(int32_t height, realv *bars)
+{
+	if (bars->empty())
+		return;
+
+	if (m_settings.use_auto_scale) {
+		const auto max_height_iter = std::max_element(bars->begin(), bars->end());
+
+		// max number of elements to calculate for moving average
+		const auto max_number_of_elements =
+			static_cast<size_t>(((constants::auto_scale_span * m_settings.sample_rate) /
+								 (static_cast<double>(m_settings.sample_size))) *
+								2.0);
+
+		const auto reset_window_size =
+			static_cast<size_t>(constants::auto_scaling_reset_window * max_number_of_elements);
+		// one more than the maximum, since the oldest value is only dropped
+		// once the window has grown past it
+		m_previous_max_heights.resize(max_number_of_elements + 1, reset_window_size);
+
+		double std_dev = 0.0;
+		double moving_average = 0.0;
+		calculate_moving_average_and_std_dev(*max_height_iter, &m_previous_max_heights, &moving_average, &std_dev);
+
+		maybe_reset_scaling_window(*max_height_iter, &m_previous_max_heights, &moving_average, &std_dev);
+
+		auto max_height = moving_average + (2 * std_dev);
+		// avoid division by zero when
+		// height is zero, this happens when
+		// the sound is muted
+		max_height = std::max(max_height, 1.0);
+
+		const auto scale = static_cast<real_t>(height / max_height);
+		const auto max_bar = static_cast<real_t>(height - 1);
+		for (real_t &bar : *bars) {
+			bar = std::min(max_bar, (bar * scale) - 1);
+		}
+	} else {
+		const auto scale_size = static_cast<real_t>(m_settings.scale_size);
+		const auto scale_boost = static_cast<real_t>(m_settings.scale_boost);
+		for (real_t &bar : *bars) {
+			bar *= scale_size;
+			bar += scale_boost;
+		}
+	}
+}
+
+void spectrum_analyzer::maybe_reset_scaling_window(double current_max_height, util::moving_window *values,
+													 double *moving_average, double *std_dev)
+{
+	const auto reset_window_size = values->head_size();
+	// Current max height is much larger than moving average, so throw away most
+	// values re-calculate
+	if (reset_window_size > 0 && values->size() > reset_window_size) {
+		// get average over scaling window
+		auto average_over_reset_window = values->head_sum() / static_cast<double>(reset_window_size);
+
+		// if short term average very different from long term moving average,
+		// reset window and re-calculate
+		if (std::abs(average_over_reset_window - *moving_average) >
+			(constants::deviation_amount_to_reset * (*std_dev))) {
+			values->drop_oldest(
+				static_cast<size_t>(static_cast<double>(values->size()) * constants::auto_scaling_erase_percent));
+
+			calculate_moving_average_and_std_dev(current_max_height, values, moving_average, std_dev);
+		}
+	}
+}
+
+void spectrum_analyzer::recalculate_cutoff_frequencies(uint32_t number_of_bars, uint32v *low_cutoff_frequencies,
+														 uint32v *high_cutoff_frequencies, doublev *freqconst_per_bin)
+{
+	auto freq_const =
+		std::log10((m_settings.low_cutoff_freq / m_settings.high_cutoff_freq)) / ((1.0 / number_of_bars + 1.0) - 1.0);
+
+	(*low_cutoff_frequencies) = std::vector<uint32_t>(number_of_bars + 1);
+	(*high_cutoff_frequencies) = std::vector<uint32_t>(number_of_bars + 1);
+	(*freqconst_per_bin) = std::vector<double>(number_of_bars + 1);
+
+	for (auto i = 0u; i <= number_of_bars; i++) {
+		(*freqconst_per_bin)[i] =
+			static_cast<double>(m_settings.high_cutoff_freq) *
+			std::pow(10.0, (freq_const * -1) + (((i + 1.0) / (number_of_bars + 1.0)) * freq_const));
+
+		auto frequency = (*freqconst_per_bin)[i] / (m_settings.sample_rate / 2.0);
+
+		(*low_cutoff_frequencies)[i] =
+			static_cast<uint32_t>(std::floor(frequency * static_cast<double>(m_spectrum_size) / 4.0));
+
+		if (i > 0) {
+			if ((*low_cutoff_frequencies)[i] <= (*low_cutoff_frequencies)[i - 1]) {
+				(*low_cutoff_frequencies)[i] = (*low_cutoff_frequencies)[i - 1] + 1;
+			}
+			(*high_cutoff_frequencies)[i - 1] = (*low_cutoff_frequencies)[i - 1];
+		}
+	}
+}
+
+void spectrum_analyzer::build_bar_mapping(uint32_t number_of_bars)
+{
+	m_bar_first_bin.resize(number_of_bars);
+	m_bar_end_bin.resize(number_of_bars);
+	m_bar_weights.resize(number_of_bars);
+	m_bins_used = 0;
+
+	for (auto i = 0u; i < number_of_bars; i++) {
+		const auto low = m_low_cutoff_frequencies[i], high = m_high_cutoff_frequencies[i];
+
+		/* Bins past the end of the fft output count as silent, but are still
+		 * part of the average */
+		m_bar_first_bin[i] = std::min(static_cast<size_t>(low), m_spectrum_results);
+		m_bar_end_bin[i] = std::max(m_bar_first_bin[i], std::min(static_cast<size_t>(high) + 1, m_spectrum_results));
+		m_bins_used = std::max(m_bins_used, m_bar_end_bin[i]);
+
+		/* average over the bins, then boost high freqs */
+		m_bar_weights[i] = std::log2(2 + i) * (100.f / number_of_bars) / (high - low + 1);
+	}
+
+	m_magnitudes.resize(m_bins_used);
+	m_magnitude_sums.resize(m_bins_used + 1);
+}
+
+void spectrum_analyzer::generate_bars(const fft_complex *fftw_output, realv *bars)
+{
+	const auto number_of_bars = m_bar_weights.size();
+	if (bars->size() != number_of_bars) {
+		bars->resize(number_of_bars, 0.0);
+	}
+
+	// All magnitudes in one vectorized pass, then every bar is the
+	// difference of two prefix sums no matter how many bins it covers
+	kernels::magnitudes(fftw_output, m_magnitudes.data(), m_bins_used);
+
+	double sum = 0.0;
+	m_magnitude_sums[0] = 0.0;
+	for (size_t i = 0; i < m_bins_used; i++) {
+		sum += m_magnitudes[i];
+		m_magnitude_sums[i + 1] = sum;
+	}
+
+	for (size_t i = 0; i < number_of_bars; i++) {
+		const auto freq_magnitude = m_magnitude_sums[m_bar_end_bin[i]] - m_magnitude_sums[m_bar_first_bin[i]];
+		(*bars)[i] = static_cast<real_t>(std::sqrt(freq_magnitude * m_bar_weights[i]));
+	}
+}
+}
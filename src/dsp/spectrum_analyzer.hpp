@@ -0,0 +1,158 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "../util/moving_window.hpp"
+#include "common.hpp"
+#include "fft_types.hpp"
+#include "spectrum_transform.hpp"
+#include <vector>
+
+/* Save some writing */
+using doublev = std::vector<double>;
+using uint32v = std::vector<uint32_t>;
+
+namespace dsp {
+
+/* Everything the analysis reads from the source config */
+struct analysis_settings {
+	uint32_t sample_rate = 44100;
+	uint32_t sample_size = 44100 / 30; /* new samples per frame */
+	uint32_t window_size = 0;          /* fft length, 0 or anything below sample_size uses sample_size */
+	window_function window = WF_NONE;
+	uint32_t detail = 32; /* visible bars, DEAD_BAR_OFFSET more are computed */
+	bool stereo = false;
+	int32_t height = 100; /* of one channel */
+
+	double low_cutoff_freq = 30, high_cutoff_freq = 22050;
+	double gravity = .8, falloff_weight = .95;
+
+	smooting_mode smoothing = SM_NONE;
+	uint32_t sgs_points = 3, sgs_passes = 2;
+	double mcat_smoothing_factor = 1.5;
+	uint16_t bar_min_height = 5;
+
+	bool use_auto_scale = true;
+	double scale_boost = 0.0, scale_size = 1.0;
+
+	double silence_threshold = -90.0; /* dBFS, input with a lower RMS counts as silent */
+
+	transform_settings to_transform() const
+	{
+		transform_settings t;
+		t.sample_size = sample_size;
+		t.window_size = window_size;
+		t.window = window;
+		t.stereo = stereo;
+		return t;
+	}
+};
+
+/* Turns blocks of stereo samples into bar heights. Doesn't depend on libobs,
+ * the stages process() runs are public so they can be timed on their own.
+ * The spectrum can also come from a transform shared with other analyzers */
+class spectrum_analyzer {
+	analysis_settings m_settings;
+
+	/* Used unless the caller brings its own spectrum */
+	spectrum_transform m_transform;
+
+	/* Frequency cutoff variables, for the fft size they were computed with */
+	uint32_t m_last_bar_count;
+	uint32_t m_spectrum_size;
+	size_t m_spectrum_results;
+	uint32v m_low_cutoff_frequencies;
+	uint32v m_high_cutoff_frequencies;
+	doublev m_frequency_constants_per_bin;
+
+	/* Bin to bar mapping, built along with the cutoff frequencies.
+	 * Bar i averages bins [first, end) and is scaled by its weight */
+	std::vector<size_t> m_bar_first_bin, m_bar_end_bin;
+	doublev m_bar_weights;
+	size_t m_bins_used;
+	realv m_magnitudes;
+	doublev m_magnitude_sums;
+
+	/* Silence detection, the levels are linear RMS */
+	bool m_silent;
+	double m_silence_level_low, m_silence_level_high;
+
+	/* New values are smoothly copied over if smoothing is used
+	 * otherwise they're directly copied */
+	realv m_bars_left, m_bars_right, m_bars_left_new, m_bars_right_new;
+	realv m_bars_falloff_left, m_bars_falloff_right;
+	util::moving_window m_previous_max_heights;
+	realv m_monstercat_smoothing_weights;
+	realv m_monstercat_sources;
+	realv m_sgs_scratch;
+
+	void build_bar_mapping(uint32_t number_of_bars);
+	void generate_bars(const fft_complex *fftw_output, realv *bars);
+	void recalculate_cutoff_frequencies(uint32_t number_of_bars, uint32v *low_cutoff_frequencies,
+										uint32v *high_cutoff_frequencies, doublev *freqconst_per_bin);
+	void smooth_bars(realv *bars);
+	void apply_falloff(const realv &bars, realv *falloff_bars) const;
+	void calculate_moving_average_and_std_dev(double new_value, util::moving_window *old_values,
+											  double *moving_average, double *std_dev) const;
+	void maybe_reset_scaling_window(double current_max_height, util::moving_window *values, double *moving_average,
+									double *std_dev);
+	void scale_bars(int32_t height, realv *bars);
+	void sgs_smoothing(realv *bars);
+	void monstercat_smoothing(realv *bars);
+	void blend_bars(const realv &bars_new, realv *bars) const;
+
+public:
+	spectrum_analyzer();
+	~spectrum_analyzer();
+
+	spectrum_analyzer(const spectrum_analyzer &) = delete;
+	spectrum_analyzer &operator=(const spectrum_analyzer &) = delete;
+
+	/* Buffers and plans are only recreated if the fft size changes */
+	void configure(const analysis_settings &settings);
+	const analysis_settings &settings() const { return m_settings; }
+
+	/* Runs all stages below in order, returns false if there's no fft plan
+	 * (yet). prepare_input() has to be called before */
+	bool process();
+	/* Runs the stages after create_bars() */
+	void process_bars();
+
+	/* Copies sample_size samples into the fft input, true if their level is below the silence threshold */
+	bool prepare_input(const float_stereo_sample *buffer);
+	/* True if the spectrum's input is below the silence threshold, for shared spectra */
+	bool check_silence(const spectrum_transform &spectrum);
+	/* Cheap test whether input with this sample peak could end the silence,
+	 * the RMS is never above the peak so nothing loud enough is missed */
+	bool above_silence(float peak) const { return peak >= m_silence_level_high; }
+	bool transform();
+	void create_bars();
+	/* The spectrum has to be transformed with this analyzer's to_transform() settings */
+	void create_bars(const spectrum_transform &spectrum);
+	void smooth();
+	void scale();
+	void update_falloff();
+	void apply_gravity();
+
+	const realv &bars_left() const { return m_bars_left; }
+	const realv &bars_right() const { return m_bars_right; }
+	const realv &falloff_left() const { return m_bars_falloff_left; }
+	const realv &falloff_right() const { return m_bars_falloff_right; }
+};
+
+}
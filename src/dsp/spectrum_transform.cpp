@@ -0,0 +1,135 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "spectrum_transform.hpp"
+#include "kernels.hpp"
+#include "plan_cache.hpp"
+#include "window.hpp"
+#include <algorithm>
+
+namespace dsp {
+spectrum_transform::spectrum_transform()
+	: m_level_left(0),
+	  m_level_right(0),
+	  m_fftw_size(0),
+	  m_fftw_results(0),
+	  m_fftw_input(nullptr),
+	  m_fftw_output(nullptr),
+	  m_fftw_plan_mono(nullptr),
+	  m_fftw_plan_stereo(nullptr),
+	  m_fftw_plan_generation(0)
+{
+}
+
+spectrum_transform::~spectrum_transform()
+{
+	free_fftw_buffers();
+}
+
+void spectrum_transform::free_fftw_buffers()
+{
+	FFTW(free)(m_fftw_input);
+	FFTW(free)(m_fftw_output);
+	m_fftw_input = nullptr;
+	m_fftw_output = nullptr;
+	m_fftw_plan_mono = m_fftw_plan_stereo = nullptr;
+}
+
+void spectrum_transform::configure(const transform_settings &settings)
+{
+	/* Reconfiguring with the same settings keeps the history */
+	if (m_fftw_plan_mono && settings == m_settings)
+		return;
+	m_settings = settings;
+
+	/* The window slides over the history by sample_size every frame, so the
+	 * frequency resolution doesn't depend on the frame rate */
+	const auto fft_size = std::max(m_settings.window_size, m_settings.sample_size);
+
+	if (fft_size > m_settings.sample_size)
+		m_history.assign(fft_size, float_stereo_sample{0.f, 0.f});
+	else
+		m_history.clear();
+
+	/* Without a window function or history the input is passed on unchanged.
+	 * Otherwise the table also makes up for the window's gain and for the
+	 * longer fft, so bars keep their height without auto scaling */
+	if (m_settings.window != WF_NONE || !m_history.empty())
+		make_window(m_settings.window, fft_size, static_cast<double>(m_settings.sample_size) / fft_size,
+					&m_window);
+	else
+		m_window.clear();
+
+	if (m_fftw_size == fft_size && m_fftw_plan_mono)
+		return;
+
+	/* Plans and buffers only change with the fft size, fftw(f)_alloc_*
+	 * aligns the buffers so the plans can use the SIMD codelets */
+	free_fftw_buffers();
+	m_fftw_size = fft_size;
+	m_fftw_results = (size_t)m_fftw_size / 2 + 1;
+	m_fftw_input = FFTW(alloc_real)(m_fftw_size * 2);
+	m_fftw_output = FFTW(alloc_complex)(m_fftw_results * 2);
+	fetch_fftw_plan();
+}
+
+void spectrum_transform::fetch_fftw_plan()
+{
+	m_fftw_plan_generation = plan_cache::generation();
+	m_fftw_plan_mono = plan_cache::get_r2c(static_cast<int>(m_fftw_size), 1, m_fftw_input, m_fftw_output);
+	m_fftw_plan_stereo = plan_cache::get_r2c(static_cast<int>(m_fftw_size), 2, m_fftw_input, m_fftw_output);
+}
+
+bool spectrum_transform::prepare_input(const float_stereo_sample *buffer)
+{
+	if (!buffer || !m_fftw_input)
+		return false;
+
+	if (!m_history.empty()) {
+		const auto hop = std::min<size_t>(m_settings.sample_size, m_history.size());
+		std::copy(m_history.begin() + hop, m_history.end(), m_history.begin());
+		std::copy(buffer, buffer + hop, m_history.end() - hop);
+		buffer = m_history.data();
+	}
+
+	/* Samples are kept in the int16 range, which all the bar
+	 * scaling and minimum heights are tuned for */
+	kernels::channel_stats left, right;
+	kernels::deinterleave(buffer, m_fftw_size, static_cast<real_t>(constants::sample_scale),
+						  m_window.empty() ? nullptr : m_window.data(), m_fftw_input,
+						  m_settings.stereo ? m_fftw_input + m_fftw_size : nullptr, &left, &right);
+
+	m_level_left = left.rms;
+	m_level_right = m_settings.stereo ? right.rms : 0.0;
+	return true;
+}
+
+bool spectrum_transform::transform()
+{
+	/* Pick up measured plans once the background planner is done */
+	if (m_fftw_plan_generation != plan_cache::generation())
+		fetch_fftw_plan();
+	auto plan = m_settings.stereo ? m_fftw_plan_stereo : m_fftw_plan_mono;
+	if (!plan)
+		return false;
+
+	/* In stereo this transforms both channels at once */
+	FFTW(execute_dft_r2c)(plan, m_fftw_input, m_fftw_output);
+	return true;
+}
+}
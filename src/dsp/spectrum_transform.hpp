@@ -0,0 +1,97 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "common.hpp"
+#include "fft_types.hpp"
+#include <vector>
+
+namespace dsp {
+
+/* Everything the transform depends on, analyzers with equal settings
+ * produce identical spectra and can share one transform */
+struct transform_settings {
+	uint32_t sample_size = 44100 / 30; /* new samples per frame */
+	uint32_t window_size = 0;          /* fft length, 0 or anything below sample_size uses sample_size */
+	window_function window = WF_NONE;
+	bool stereo = false;
+
+	bool operator==(const transform_settings &o) const
+	{
+		return sample_size == o.sample_size && window_size == o.window_size && window == o.window &&
+			   stereo == o.stereo;
+	}
+	bool operator!=(const transform_settings &o) const { return !(*this == o); }
+};
+
+/* Windowing and fft of the input, the part of the analysis that doesn't
+ * depend on how the spectrum is turned into bars */
+class spectrum_transform {
+	transform_settings m_settings;
+
+	/* The last m_fftw_size frames, the newest sample_size of them are shifted in
+	 * every frame. Empty if the window is just the current block */
+	std::vector<float_stereo_sample> m_history;
+	/* Window function with the amplitude correction, empty if not needed */
+	realv m_window;
+
+	/* Linear RMS of the last input, right is zero in mono */
+	double m_level_left, m_level_right;
+
+	/* fft calculation vars */
+	uint32_t m_fftw_size;
+	size_t m_fftw_results;
+	/* Both channels live in one buffer, one after the other, so
+	 * stereo can be done in a single batched transform */
+	real_t *m_fftw_input;
+	fft_complex *m_fftw_output;
+
+	/* Owned by the plan cache */
+	fft_plan m_fftw_plan_mono;
+	fft_plan m_fftw_plan_stereo;
+	uint32_t m_fftw_plan_generation;
+
+	void free_fftw_buffers();
+	void fetch_fftw_plan();
+
+public:
+	spectrum_transform();
+	~spectrum_transform();
+
+	spectrum_transform(const spectrum_transform &) = delete;
+	spectrum_transform &operator=(const spectrum_transform &) = delete;
+
+	/* Buffers and plans are only recreated if the fft size changes */
+	void configure(const transform_settings &settings);
+	const transform_settings &settings() const { return m_settings; }
+
+	/* Shifts sample_size new samples into the fft input, false if not configured yet */
+	bool prepare_input(const float_stereo_sample *buffer);
+	/* False if there's no fft plan (yet) */
+	bool transform();
+
+	double level_left() const { return m_level_left; }
+	double level_right() const { return m_level_right; }
+
+	uint32_t size() const { return m_fftw_size; }
+	size_t results() const { return m_fftw_results; }
+	const fft_complex *output_left() const { return m_fftw_output; }
+	const fft_complex *output_right() const { return m_fftw_output + m_fftw_results; }
+};
+
+}
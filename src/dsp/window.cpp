@@ -0,0 +1,53 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "window.hpp"
+#include <cmath>
+
+namespace dsp {
+
+void make_window(window_function function, size_t size, double gain, realv *table)
+{
+	const double two_pi = 2 * 3.14159265358979323846;
+	std::vector<double> w(size, 1.0);
+
+	/* Periodic windows, since the ffts overlap */
+	for (size_t i = 0; i < size; i++) {
+		const double x = two_pi * i / size;
+		switch (function) {
+		case WF_HANN:
+			w[i] = 0.5 - 0.5 * std::cos(x);
+			break;
+		case WF_BLACKMAN:
+			w[i] = 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2 * x);
+			break;
+		default:;
+		}
+	}
+
+	double sum = 0.0;
+	for (const auto v : w)
+		sum += v;
+	const double scale = sum > 0 ? gain * size / sum : gain;
+
+	table->resize(size);
+	for (size_t i = 0; i < size; i++)
+		(*table)[i] = static_cast<real_t>(w[i] * scale);
+}
+
+}
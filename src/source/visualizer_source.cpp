@@ -20,6 +20,9 @@
 #include "../util/audio/bar_visualizer.hpp"
 #include "../util/audio/wire_visualizer.hpp"
 #include "../util/util.hpp"
+#include <callback/proc.h>
+
+#define STATS_LOG_INTERVAL_NS 10000000000ULL
 
 namespace source {
 
@@ -31,126 +34,283 @@ struct enum_data {
 	obs_property *list;
 };
 
-visualizer_source::visualizer_source(obs_source_t *source, obs_data_t *settings)
+visualizer_source::visualizer_source(obs_source_t *source, obs_data_t *settings) : m_source(source)
 {
-	m_config.settings = settings;
-	m_config.source = source;
+	m_config.stats = &m_stats;
+
+	/* Lets scripts and plugins find out which instance eats the frame budget */
+	proc_handler_add(
+		obs_source_get_proc_handler(source), "void get_stats(in bool reset, out string stats)",
+		[](void *data, calldata_t *cd) {
+			auto stats = reinterpret_cast<visualizer_source *>(data)->stats(calldata_get_bool(cd, "reset"));
+			calldata_set_string(cd, "stats", stats.c_str());
+		},
+		this);
 
 	update(settings);
+	m_analysis_thread = std::thread(&visualizer_source::analysis_thread, this);
 }
 
 visualizer_source::~visualizer_source()
 {
-	m_config.value_mutex.lock();
-	delete m_visualizer;
+	{
+		std::lock_guard<std::mutex> lock(m_analysis_mutex);
+		m_analysis_stop = true;
+	}
+	m_analysis_cv.notify_one();
+	m_analysis_thread.join();
+
+	/* m_visualizer is either still waiting for render() or already drawn by it */
+	obs_enter_graphics();
+	delete m_next_visualizer.exchange(nullptr);
+	delete m_drawn_visualizer;
+	m_drawn_visualizer = nullptr;
 	m_visualizer = nullptr;
+	gs_texrender_destroy(m_texrender);
+	m_texrender = nullptr;
+	obs_leave_graphics();
 
 	if (m_config.buffer) {
 		bfree(m_config.buffer);
 		m_config.buffer = nullptr;
 	}
-	m_config.value_mutex.unlock();
 }
 
 void visualizer_source::update(obs_data_t *settings)
 {
-	visual_mode old_mode = m_config.visual;
-
-	m_config.value_mutex.lock();
-	m_config.audio_source_name = obs_data_get_string(settings, S_AUDIO_SOURCE);
-	m_config.sample_rate = obs_data_get_int(settings, S_SAMPLE_RATE);
-	m_config.sample_size = m_config.sample_rate / m_config.fps;
-	m_config.visual = (visual_mode)(obs_data_get_int(settings, S_SOURCE_MODE));
-	m_config.stereo = obs_data_get_bool(settings, S_STEREO);
-	m_config.stereo_space = obs_data_get_int(settings, S_STEREO_SPACE);
-	m_config.color = obs_data_get_int(settings, S_COLOR);
-	m_config.bar_width = obs_data_get_int(settings, S_BAR_WIDTH);
-	m_config.bar_space = obs_data_get_int(settings, S_BAR_SPACE);
-	m_config.detail = obs_data_get_int(settings, S_DETAIL);
-	m_config.fifo_path = obs_data_get_string(settings, S_FIFO_PATH);
-	m_config.bar_height = obs_data_get_int(settings, S_BAR_HEIGHT);
-	m_config.smoothing = (smooting_mode)obs_data_get_int(settings, S_FILTER_MODE);
-	m_config.sgs_passes = obs_data_get_int(settings, S_SGS_PASSES);
-	m_config.sgs_points = obs_data_get_int(settings, S_SGS_POINTS);
-	m_config.falloff_weight = obs_data_get_double(settings, S_FALLOFF);
-	m_config.gravity = obs_data_get_double(settings, S_GRAVITY);
-	m_config.mcat_smoothing_factor = obs_data_get_double(settings, S_FILTER_STRENGTH);
-	m_config.cx = UTIL_MAX(m_config.detail * (m_config.bar_width + m_config.bar_space) - m_config.bar_space, 10);
-	m_config.cy = UTIL_MAX(m_config.bar_height + (m_config.stereo ? m_config.stereo_space : 0), 10);
-	m_config.use_auto_scale = obs_data_get_bool(settings, S_AUTO_SCALE);
-	m_config.scale_boost = obs_data_get_double(settings, S_SCALE_BOOST);
-	m_config.scale_size = obs_data_get_double(settings, S_SCALE_SIZE);
-	m_config.wire_mode = (wire_mode)obs_data_get_int(settings, S_WIRE_MODE);
-	m_config.wire_thickness = obs_data_get_int(settings, S_WIRE_THICKNESS);
+	/* A new snapshot every time, the ones still in use elsewhere stay valid */
+	auto cfg = std::make_shared<source::settings>();
 
 #ifdef LINUX
-	m_config.auto_clear = obs_data_get_bool(settings, S_AUTO_CLEAR);
+	cfg->auto_clear = obs_data_get_bool(settings, S_AUTO_CLEAR);
 
 	struct obs_video_info ovi;
 	if (obs_get_video_info(&ovi)) {
-		m_config.fps = ovi.fps_num;
+		cfg->fps = ovi.fps_num;
 	} else {
-		m_config.fps = 30;
+		cfg->fps = 30;
 		warn("Couldn't determine fps, mpd fifo might not work as intended!");
 	}
 #endif
 
-	if (m_visualizer) /* this modifies sample size, if an internal audio source is used */
-		m_visualizer->update();
+	cfg->audio_source_name = obs_data_get_string(settings, S_AUDIO_SOURCE);
+	cfg->sample_rate = obs_data_get_int(settings, S_SAMPLE_RATE);
+	cfg->sample_size = cfg->sample_rate / cfg->fps;
+	cfg->visual = (visual_mode)(obs_data_get_int(settings, S_SOURCE_MODE));
+	cfg->stereo = obs_data_get_bool(settings, S_STEREO);
+	cfg->stereo_space = obs_data_get_int(settings, S_STEREO_SPACE);
+	cfg->color = obs_data_get_int(settings, S_COLOR);
+	cfg->bar_width = obs_data_get_int(settings, S_BAR_WIDTH);
+	cfg->bar_space = obs_data_get_int(settings, S_BAR_SPACE);
+	cfg->detail = obs_data_get_int(settings, S_DETAIL);
+	cfg->fifo_path = obs_data_get_string(settings, S_FIFO_PATH);
+	cfg->fifo_latency = obs_data_get_int(settings, S_FIFO_LATENCY);
+	cfg->shm_name = obs_data_get_string(settings, S_SHM_NAME);
+	cfg->bar_height = obs_data_get_int(settings, S_BAR_HEIGHT);
+	cfg->smoothing = (smooting_mode)obs_data_get_int(settings, S_FILTER_MODE);
+	cfg->sgs_passes = obs_data_get_int(settings, S_SGS_PASSES);
+	cfg->sgs_points = obs_data_get_int(settings, S_SGS_POINTS);
+	cfg->falloff_weight = obs_data_get_double(settings, S_FALLOFF);
+	cfg->gravity = obs_data_get_double(settings, S_GRAVITY);
+	cfg->mcat_smoothing_factor = obs_data_get_double(settings, S_FILTER_STRENGTH);
+	cfg->cx = UTIL_MAX(cfg->detail * (cfg->bar_width + cfg->bar_space) - cfg->bar_space, 10);
+	cfg->cy = UTIL_MAX(cfg->bar_height + (cfg->stereo ? cfg->stereo_space : 0), 10);
+	cfg->use_auto_scale = obs_data_get_bool(settings, S_AUTO_SCALE);
+	cfg->scale_boost = obs_data_get_double(settings, S_SCALE_BOOST);
+	cfg->scale_size = obs_data_get_double(settings, S_SCALE_SIZE);
+	cfg->wire_mode = (wire_mode)obs_data_get_int(settings, S_WIRE_MODE);
+	cfg->wire_thickness = obs_data_get_int(settings, S_WIRE_THICKNESS);
+	cfg->silence_threshold = obs_data_get_double(settings, S_SILENCE_THRESHOLD);
+	cfg->window_size = obs_data_get_int(settings, S_WINDOW_SIZE);
+	cfg->window = (window_function)obs_data_get_int(settings, S_WINDOW_FUNCTION);
+	cfg->log_stats = obs_data_get_bool(settings, S_LOG_STATS);
+
+	/* The analysis thread applies it before its next tick, render() with the next frame */
+	std::atomic_store(&m_settings, std::shared_ptr<const source::settings>(cfg));
+}
 
-	if (m_config.buffer)
-		bfree(m_config.buffer);
+void visualizer_source::apply_settings()
+{
+	auto latest = std::atomic_load(&m_settings);
+	if (latest == m_applied)
+		return;
+	m_applied = latest;
 
-	m_config.buffer = static_cast<pcm_stereo_sample *>(bzalloc(m_config.sample_size * sizeof(pcm_stereo_sample)));
+	visual_mode old_mode = m_config.visual;
+	static_cast<settings &>(m_config) = *latest;
+
+	if (m_visualizer) /* this modifies sample size, if an internal audio source is used */
+		m_visualizer->update();
 
 	if (old_mode != m_config.visual || !m_visualizer) {
-		delete m_visualizer;
+		audio::audio_visualizer *new_visualizer = nullptr;
 
 		switch (m_config.visual) {
 		case VM_BARS:
-			m_visualizer = new audio::bar_visualizer(&m_config);
+			new_visualizer = new audio::bar_visualizer(&m_config);
 			break;
 		case VM_WIRE:
-			m_visualizer = new audio::wire_visualizer(&m_config);
+			new_visualizer = new audio::wire_visualizer(&m_config);
 			break;
 		}
+
+		/* render() swaps it in and deletes the old one. A visualizer that was
+		 * replaced before render() got to it was never drawn, so it can go here */
+		delete m_next_visualizer.exchange(new_visualizer);
+		m_visualizer = new_visualizer;
 	}
 
-	m_config.value_mutex.unlock();
+	/* Only a different sample size needs a new buffer, other changes
+	 * keep the samples that were already read */
+	if (!m_config.buffer || m_buffer_size != m_config.sample_size) {
+		bfree(m_config.buffer);
+		m_config.buffer =
+			static_cast<float_stereo_sample *>(bzalloc(m_config.sample_size * sizeof(float_stereo_sample)));
+		m_buffer_size = m_config.sample_size;
+	}
 }
 
 void visualizer_source::tick(float seconds)
 {
-	m_config.value_mutex.lock();
+	{
+		std::lock_guard<std::mutex> lock(m_analysis_mutex);
+		m_pending_seconds += seconds;
+		m_pending_frame_time = obs_get_video_frame_time();
+	}
+	m_analysis_cv.notify_one();
+}
+
+void visualizer_source::analysis_thread()
+{
+	std::unique_lock<std::mutex> lock(m_analysis_mutex);
+
+	for (;;) {
+		m_analysis_cv.wait(lock, [this] { return m_analysis_stop || m_pending_seconds > 0.f; });
+		if (m_analysis_stop)
+			break;
 
-	if (m_visualizer)
-		m_visualizer->tick(seconds);
+		/* Ticks that came in while the last run was busy are merged into one */
+		float seconds = m_pending_seconds;
+		uint64_t frame_time = m_pending_frame_time;
+		m_pending_seconds = 0.f;
+		lock.unlock();
 
-	m_config.value_mutex.unlock();
+		/* Settings changes are picked up between ticks, so neither side waits for the other */
+		apply_settings();
+
+		/* Visualizers sharing an analysis use this to only run it once per frame */
+		m_config.frame_time = frame_time;
+		if (m_visualizer)
+			m_visualizer->tick(seconds);
+		if (m_config.log_stats)
+			log_stats();
+
+		lock.lock();
+	}
+}
+
+void visualizer_source::log_stats()
+{
+	const uint64_t now = os_gettime_ns();
+	if (m_last_stats_log && now - m_last_stats_log < STATS_LOG_INTERVAL_NS)
+		return;
+
+	/* Each summary only covers the time since the last one */
+	if (m_last_stats_log)
+		info("Timings of '%s' in us: %s", obs_source_get_name(m_source), m_stats.to_json().c_str());
+	m_stats.reset();
+	m_last_stats_log = now;
+}
+
+std::string visualizer_source::stats(bool reset)
+{
+	auto json = m_stats.to_json();
+	if (reset)
+		m_stats.reset();
+	return json;
 }
 
 void visualizer_source::render(gs_effect_t *effect)
 {
 	UNUSED_PARAMETER(effect);
-	if (m_visualizer) {
-		m_config.value_mutex.lock();
-		gs_effect_t *solid = obs_get_base_effect(OBS_EFFECT_SOLID);
-		gs_eparam_t *color = gs_effect_get_param_by_name(solid, "color");
-		gs_technique_t *tech = gs_effect_get_technique(solid, "Solid");
 
-		struct vec4 colorVal;
-		vec4_from_rgba(&colorVal, m_config.color);
-		gs_effect_set_vec4(color, &colorVal);
+	/* Deleting the old visualizer is safe here, the analysis thread moved on to the new one */
+	bool swapped = false;
+	if (auto *next = m_next_visualizer.exchange(nullptr)) {
+		delete m_drawn_visualizer;
+		m_drawn_visualizer = next;
+		swapped = true;
+	}
+	if (!m_drawn_visualizer)
+		return;
+
+	util::stage_timer timer(&m_stats, util::ST_RENDER);
 
-		gs_technique_begin(tech);
-		gs_technique_begin_pass(tech, 0);
+	if (!m_texrender)
+		m_texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
 
-		m_visualizer->render(solid);
+	/* Idle visualizers just show the cached texture, so dozens of them in a scene
+	 * cost little more than a sprite each */
+	const auto cfg = std::atomic_load(&m_settings);
+	bool redraw = m_drawn_visualizer->update_frame();
 
-		gs_technique_end_pass(tech);
-		gs_technique_end(tech);
-		m_config.value_mutex.unlock();
+	/* How old the audio is by the time its frame gets drawn */
+	const uint64_t timestamp = redraw ? m_drawn_visualizer->frame_timestamp() : 0;
+	if (timestamp) {
+		const uint64_t now = os_gettime_ns();
+		if (now > timestamp)
+			m_stats.record_latency(now - timestamp);
 	}
+	redraw = swapped || redraw || cfg != m_drawn || !gs_texrender_get_texture(m_texrender);
+
+	if (redraw) {
+		m_drawn = cfg;
+		gs_texrender_reset(m_texrender);
+		if (gs_texrender_begin(m_texrender, cfg->cx, cfg->cy)) {
+			struct vec4 clear;
+			vec4_zero(&clear);
+			gs_clear(GS_CLEAR_COLOR, &clear, 0.f, 0);
+			gs_ortho(0.f, static_cast<float>(cfg->cx), 0.f, static_cast<float>(cfg->cy), -100.f, 100.f);
+
+			/* Keep the alpha channel right, the texture ends up premultiplied */
+			gs_blend_state_push();
+			gs_blend_function_separate(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA, GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+			draw_visualizer(*cfg);
+			gs_blend_state_pop();
+			gs_texrender_end(m_texrender);
+		}
+	}
+
+	gs_texture_t *tex = gs_texrender_get_texture(m_texrender);
+	if (!tex)
+		return;
+
+	gs_effect_t *def = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	gs_effect_set_texture(gs_effect_get_param_by_name(def, "image"), tex);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+	while (gs_effect_loop(def, "Draw"))
+		gs_draw_sprite(tex, 0, cfg->cx, cfg->cy);
+	gs_blend_state_pop();
+}
+
+void visualizer_source::draw_visualizer(const settings &cfg)
+{
+	gs_effect_t *solid = obs_get_base_effect(OBS_EFFECT_SOLID);
+	gs_eparam_t *color = gs_effect_get_param_by_name(solid, "color");
+	gs_technique_t *tech = gs_effect_get_technique(solid, "Solid");
+
+	struct vec4 colorVal;
+	vec4_from_rgba(&colorVal, cfg.color);
+	gs_effect_set_vec4(color, &colorVal);
+
+	gs_technique_begin(tech);
+	gs_technique_begin_pass(tech, 0);
+
+	m_drawn_visualizer->render(cfg, solid);
+
+	gs_technique_end_pass(tech);
+	gs_technique_end(tech);
 }
 
 static bool filter_changed(obs_properties_t *props, obs_property_t *p, obs_data_t *data)
@@ -191,15 +351,21 @@ static bool source_changed(obs_properties_t *props, obs_property_t *p, obs_data_
 {
 	auto *id = obs_data_get_string(data, S_AUDIO_SOURCE);
 	auto *sr = obs_properties_get(props, S_SAMPLE_RATE);
-	obs_property_t *fifo = nullptr;
+	obs_property_t *fifo = nullptr, *latency = nullptr, *shm = nullptr;
 #ifdef LINUX
 	fifo = obs_properties_get(props, S_FIFO_PATH);
+	latency = obs_properties_get(props, S_FIFO_LATENCY);
+	shm = obs_properties_get(props, S_SHM_NAME);
 #endif
 	if (strcmp(id, "mpd") == 0) {
 		obs_property_set_visible(sr, true);
 		if (fifo) {
 			obs_property_set_visible(fifo, true);
+			obs_property_set_visible(latency, true);
 		}
+	} else if (strcmp(id, "shm") == 0 && shm) {
+		/* The sample rate is part of the shared memory header */
+		obs_property_set_visible(shm, true);
 	}
 	return true;
 }
@@ -312,15 +478,43 @@ obs_properties_t *get_properties_for_visualiser(void *data)
 	obs_properties_add_float_slider(props, S_GRAVITY, T_GRAVITY, 0, 1, 0.01);
 	obs_properties_add_float_slider(props, S_FALLOFF, T_FALLOFF, 0, 2, 0.01);
 
+	/* A longer window gives finer frequencies, independent of the frame rate */
+	auto *ws = obs_properties_add_list(props, S_WINDOW_SIZE, T_WINDOW_SIZE, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(ws, T_WINDOW_SIZE_AUTO, 0);
+	obs_property_list_add_int(ws, "1024", 1024);
+	obs_property_list_add_int(ws, "2048", 2048);
+	obs_property_list_add_int(ws, "4096", 4096);
+	obs_property_list_add_int(ws, "8192", 8192);
+	auto *wf =
+		obs_properties_add_list(props, S_WINDOW_FUNCTION, T_WINDOW_FUNCTION, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(wf, T_WINDOW_NONE, WF_NONE);
+	obs_property_list_add_int(wf, T_WINDOW_HANN, WF_HANN);
+	obs_property_list_add_int(wf, T_WINDOW_BLACKMAN, WF_BLACKMAN);
+
+	/* Analysis pauses while the input stays below this */
+	auto *silence = obs_properties_add_float_slider(props, S_SILENCE_THRESHOLD, T_SILENCE_THRESHOLD, -120, 0, 1);
+	obs_property_float_set_suffix(silence, " dB");
+
 	obs_property_list_add_string(src, T_AUDIO_SOURCE_NONE, defaults::audio_source);
 #ifdef LINUX
 	/* Add MPD stuff */
 	obs_property_list_add_string(src, T_SOURCE_MPD, "mpd");
 	auto *path = obs_properties_add_path(props, S_FIFO_PATH, T_FIFO_PATH, OBS_PATH_FILE, fifo_filter, "");
 	obs_property_set_visible(path, false);
+	/* Anything queued up past this is skipped to catch up with the music */
+	auto *latency = obs_properties_add_int_slider(props, S_FIFO_LATENCY, T_FIFO_LATENCY, 0, 1000, 10);
+	obs_property_int_set_suffix(latency, " ms");
+	obs_property_set_visible(latency, false);
+	/* Audio written to shared memory by a local process */
+	obs_property_list_add_string(src, T_SOURCE_SHM, "shm");
+	auto *shm = obs_properties_add_text(props, S_SHM_NAME, T_SHM_NAME, OBS_TEXT_DEFAULT);
+	obs_property_set_visible(shm, false);
 	obs_properties_add_bool(props, S_AUTO_CLEAR, T_AUTO_CLEAR);
 #endif
 
+	/* Logged every ten seconds, also available through the get_stats proc */
+	obs_properties_add_bool(props, S_LOG_STATS, T_LOG_STATS);
+
 	auto *stereo = obs_properties_add_bool(props, S_STEREO, T_STEREO);
 	auto *space = obs_properties_add_int(props, S_STEREO_SPACE, T_STEREO_SPACE, 0, UINT16_MAX, 1);
 	obs_property_int_set_suffix(space, " Pixel");
@@ -364,6 +558,8 @@ void register_visualiser()
 		obs_data_set_default_double(settings, S_GRAVITY, defaults::gravity);
 		obs_data_set_default_double(settings, S_FALLOFF, defaults::falloff_weight);
 		obs_data_set_default_string(settings, S_FIFO_PATH, defaults::fifo_path);
+		obs_data_set_default_int(settings, S_FIFO_LATENCY, defaults::fifo_latency);
+		obs_data_set_default_string(settings, S_SHM_NAME, defaults::shm_name);
 		obs_data_set_default_int(settings, S_SGS_PASSES, defaults::sgs_passes);
 		obs_data_set_default_int(settings, S_SGS_POINTS, defaults::sgs_points);
 		obs_data_set_default_int(settings, S_BAR_WIDTH, defaults::bar_width);
@@ -374,6 +570,10 @@ void register_visualiser()
 		obs_data_set_default_double(settings, S_SCALE_BOOST, defaults::scale_boost);
 		obs_data_set_default_int(settings, S_WIRE_MODE, defaults::wire_mode);
 		obs_data_set_default_int(settings, S_WIRE_THICKNESS, defaults::wire_thickness);
+		obs_data_set_default_double(settings, S_SILENCE_THRESHOLD, defaults::silence_threshold);
+		obs_data_set_default_int(settings, S_WINDOW_SIZE, defaults::window_size);
+		obs_data_set_default_int(settings, S_WINDOW_FUNCTION, defaults::window);
+		obs_data_set_default_bool(settings, S_LOG_STATS, defaults::log_stats);
 	};
 
 	si.update = [](void *data, obs_data_t *settings) { reinterpret_cast<visualizer_source *>(data)->update(settings); };
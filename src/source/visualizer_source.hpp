@@ -6,11 +6,16 @@
  */
 #pragma once
 
+#include "../util/stage_stats.hpp"
 #include "../util/util.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <obs-module.h>
+#include <thread>
 
 namespace audio {
 class audio_visualizer;
@@ -18,17 +23,14 @@ class audio_visualizer;
 
 namespace source {
 
-struct config {
-	std::mutex value_mutex;
-
-	/* obs source stuff */
-	obs_source_t *source = nullptr;
-	obs_data_t *settings = nullptr;
-
+/* Everything update() reads from the source settings. Published as an immutable
+ * snapshot, so the analysis thread and render() pick up changes without locking */
+struct settings {
 	/* Misc */
-	const char *fifo_path = defaults::fifo_path;
+	std::string fifo_path = defaults::fifo_path;
+	uint32_t fifo_latency = defaults::fifo_latency;
+	std::string shm_name = defaults::shm_name;
 	bool auto_clear = false;
-	pcm_stereo_sample *buffer = nullptr;
 
 	/* Appearance settings */
 	visual_mode visual = defaults::visual;
@@ -40,6 +42,8 @@ struct config {
 	/* Audio settings */
 	uint32_t sample_rate = defaults::sample_rate;
 	uint32_t sample_size = defaults::sample_size;
+	uint32_t window_size = defaults::window_size;
+	window_function window = defaults::window;
 
 	std::string audio_source_name = "";
 	double low_cutoff_freq = defaults::lfreq_cut;
@@ -70,13 +74,61 @@ struct config {
 	uint16_t stereo_space = 0;
 	double falloff_weight = defaults::falloff_weight;
 	double gravity = defaults::gravity;
+	double silence_threshold = defaults::silence_threshold;
+
+	bool log_stats = defaults::log_stats; /* periodic summary of the stage timings */
+};
+
+/* The copy of the settings audio sources and visualizers work with, only touched
+ * by the thread that owns it. Sources write back the sample rate and size they use */
+struct config : settings {
+	float_stereo_sample *buffer = nullptr; /* samples in [-1, 1] */
+	uint64_t frame_time = 0;               /* video frame the current tick belongs to */
+	util::stage_stats *stats = nullptr;    /* of the source this config belongs to */
 };
 
 class visualizer_source {
+	obs_source_t *m_source = nullptr;
+
+	/* Stage timings, recorded by the analysis thread and render() */
+	util::stage_stats m_stats;
+	uint64_t m_last_stats_log = 0;
+
+	/* Written by update(), read with atomic_load */
+	std::shared_ptr<const settings> m_settings;
+
+	/* Owned by the analysis thread, which applies new snapshots between ticks */
 	config m_config;
+	std::shared_ptr<const settings> m_applied;
+	uint32_t m_buffer_size = 0; /* samples m_config.buffer was allocated for */
 	audio::audio_visualizer *m_visualizer = nullptr;
+
+	/* A visualizer built for a new mode, render() takes it over and deletes
+	 * the one it replaces, so the analysis thread never needs the graphics lock */
+	std::atomic<audio::audio_visualizer *> m_next_visualizer{nullptr};
 	std::map<uint16_t, std::string> m_source_names;
 
+	/* Audio reading and analysis runs on its own thread, so render()
+	 * never has to wait for it */
+	std::thread m_analysis_thread;
+	std::mutex m_analysis_mutex;
+	std::condition_variable m_analysis_cv;
+	float m_pending_seconds = 0.f;
+	uint64_t m_pending_frame_time = 0;
+	bool m_analysis_stop = false;
+
+	void analysis_thread();
+	void apply_settings();
+	void log_stats();
+
+	/* The visualizer draws into this, and it's only redrawn if the analysis
+	 * published new bars or the settings changed. Only used in the graphics context */
+	gs_texrender_t *m_texrender = nullptr;
+	audio::audio_visualizer *m_drawn_visualizer = nullptr;
+	std::shared_ptr<const settings> m_drawn;
+
+	void draw_visualizer(const settings &cfg);
+
 public:
 	visualizer_source(obs_source_t *source, obs_data_t *settings);
 	~visualizer_source();
@@ -85,9 +137,12 @@ public:
 	inline void tick(float seconds);
 	inline void render(gs_effect_t *effect);
 
-	uint32_t get_width() const { return m_config.cx; }
+	uint32_t get_width() const { return std::atomic_load(&m_settings)->cx; }
+
+	uint32_t get_height() const { return std::atomic_load(&m_settings)->cy; }
 
-	uint32_t get_height() const { return m_config.cy; }
+	/* Timings of every stage as JSON, see util::stage_stats */
+	std::string stats(bool reset);
 
 	void clear_source_names() { m_source_names.clear(); }
 	void add_source(uint16_t id, const char *name) { m_source_names[id] = name; }
@@ -17,7 +17,11 @@
  *************************************************************************/
 
 #include "source/visualizer_source.hpp"
+#include "dsp/kernels.hpp"
+#include "dsp/plan_cache.hpp"
+#include "util/util.hpp"
 #include <obs-module.h>
+#include <util/platform.h>
 
 OBS_DECLARE_MODULE()
 
@@ -28,13 +32,38 @@ MODULE_EXPORT const char *obs_module_description(void)
 	return "Spectrum visualizer";
 }
 
+#ifdef SPECTRALIZER_DOUBLE_PRECISION
+#define WISDOM_FILE "fftw_wisdom"
+#else
+#define WISDOM_FILE "fftwf_wisdom"
+#endif
+
 bool obs_module_load()
 {
+	dsp::plan_cache::init();
+	info("Using %s analysis kernels", dsp::kernels::instruction_set());
+
+	char *wisdom = obs_module_config_path(WISDOM_FILE);
+	if (wisdom && dsp::plan_cache::import_wisdom(wisdom))
+		info("Loaded fftw wisdom from '%s'", wisdom);
+	bfree(wisdom);
+
 	source::register_visualiser();
 	return true;
 }
 
 void obs_module_unload()
 {
-	/* NO-OP */
+	char *config = obs_module_config_path("");
+	char *wisdom = obs_module_config_path(WISDOM_FILE);
+
+	if (config && wisdom) {
+		os_mkdirs(config);
+		if (!dsp::plan_cache::export_wisdom(wisdom))
+			warn("Couldn't save fftw wisdom to '%s'", wisdom);
+	}
+	bfree(config);
+	bfree(wisdom);
+
+	dsp::plan_cache::clear();
 }
@@ -0,0 +1,121 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+/* Checks the linear monstercat filter against the original version that
+ * compared every pair of bars. Usage: spectralizer_monstercat_test */
+
+#include "../dsp/monstercat.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+const real_t min_height = 5; /* defaults::bar_min_height */
+
+/* The filter before it was made linear, kept as the reference */
+void monstercat_reference(double factor, realv *bars)
+{
+	const auto bars_length = static_cast<int64_t>(bars->size());
+	realv weights(bars->size());
+	for (size_t i = 0; i < bars->size(); ++i)
+		weights[i] = std::pow(factor, i);
+
+	for (int64_t i = 1; i < bars_length; ++i) {
+		const auto outer_index = static_cast<size_t>(i);
+
+		if ((*bars)[outer_index] < min_height) {
+			(*bars)[outer_index] = min_height;
+		} else {
+			for (int64_t j = 0; j < bars_length; ++j) {
+				if (i != j) {
+					const auto index = static_cast<size_t>(j);
+					const auto weighted_value = (*bars)[outer_index] / weights[static_cast<size_t>(std::abs(i - j))];
+					if ((*bars)[index] < weighted_value)
+						(*bars)[index] = weighted_value;
+				}
+			}
+		}
+	}
+}
+
+bool test_monstercat()
+{
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<size_t> length(1, 300);
+	std::uniform_real_distribution<real_t> height(0, 150);
+	std::uniform_int_distribution<int> peak(0, 9);
+
+	/* The whole range of the strength slider, plus a few values outside of it */
+	std::vector<double> factors = {1.001, 1.005, 2.0, 3.0, 5.0, 10.0};
+	for (int i = 0; i <= 50; i++)
+		factors.push_back(1.0 + i / 100.0);
+
+	size_t values = 0, pixel_errors = 0;
+	double max_error = 0;
+
+	for (const auto factor : factors) {
+		realv weights, sources;
+
+		for (int run = 0; run < 20; run++) {
+			/* Every other run has sparse peaks, which makes long decay chains */
+			realv bars(length(rng));
+			for (auto &b : bars)
+				b = run % 2 || !peak(rng) ? height(rng) : height(rng) / 20;
+			auto expected = bars;
+
+			weights.resize(bars.size());
+			for (size_t i = 0; i < bars.size(); i++)
+				weights[i] = std::pow(factor, i);
+			dsp::monstercat_filter(&bars, weights, min_height, &sources);
+			monstercat_reference(factor, &expected);
+
+			for (size_t i = 0; i < bars.size(); i++) {
+				const double error = std::fabs(bars[i] - expected[i]) / std::max<double>(std::fabs(expected[i]), 1e-9);
+				max_error = std::max(max_error, error);
+				if (std::round(bars[i]) != std::round(expected[i]))
+					pixel_errors++;
+				values++;
+			}
+		}
+	}
+
+	const double epsilon = std::numeric_limits<real_t>::epsilon();
+	printf("monstercat: %zu values, max relative error %g (%.1f epsilon), %zu pixel differences\n", values,
+		   max_error, max_error / epsilon, pixel_errors);
+
+	/* Not bit-identical: the original took the max over every chain of divisions
+	 * between two bars, which round differently, while the sweeps only follow one.
+	 * Over 5 million random values the largest difference was 91 epsilon (factor 1.001,
+	 * long decay chains) and 27 epsilon within the slider range, in float and double.
+	 * So an error this small can only move a bar across a pixel boundary it already
+	 * touches, which happens for about 1 in 100k values */
+	return max_error <= 128 * epsilon;
+}
+
+}
+
+int main()
+{
+	bool ok = test_monstercat();
+	printf("%s\n", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+/* Reference writer for the shared memory audio source. Either plays a slow
+ * sine sweep or forwards raw interleaved samples from stdin, e.g.
+ *   ffmpeg -re -i song.flac -f f32le -ac 2 -ar 48000 - | spectralizer_shm_writer -f f32 -s
+ * Usage: spectralizer_shm_writer [-n name] [-r rate] [-c channels] [-f s16|f32] [-s] */
+
+#include "../util/audio/shm_ring.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const uint32_t ring_capacity = 1 << 16; /* ~1.4s at 48kHz */
+const uint32_t block_frames = 480;      /* 10ms at 48kHz */
+
+volatile std::sig_atomic_t running = 1;
+
+void stop(int)
+{
+	running = 0;
+}
+
+/* Logarithmic sweep from 40Hz to 12kHz and back, the right channel lags a bit behind */
+float sweep(double t, double offset)
+{
+	const double period = 10.0, low = 40.0, high = 12000.0;
+	double phase = std::fmod(t + offset, period) / period;
+	phase = phase < 0.5 ? phase * 2 : (1 - phase) * 2;
+	const double k = std::log(high / low);
+	/* Integral of the instantaneous frequency low * e^(k * phase) */
+	return static_cast<float>(0.5 * std::sin(2 * M_PI * low * period / 2 / k * std::exp(k * phase)));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = "/spectralizer";
+	uint32_t rate = 48000, channels = 2, format = audio::shm::SF_F32;
+	bool from_stdin = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:r:c:f:s")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'r':
+			rate = static_cast<uint32_t>(std::atoi(optarg));
+			break;
+		case 'c':
+			channels = static_cast<uint32_t>(std::atoi(optarg));
+			break;
+		case 'f':
+			format = std::strcmp(optarg, "s16") == 0 ? audio::shm::SF_S16 : audio::shm::SF_F32;
+			break;
+		case 's':
+			from_stdin = true;
+			break;
+		default:
+			std::fprintf(stderr, "Usage: %s [-n name] [-r rate] [-c channels] [-f s16|f32] [-s]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (rate == 0 || channels < 1 || channels > 2) {
+		std::fprintf(stderr, "Unsupported rate or channel count\n");
+		return 1;
+	}
+
+	const size_t size = audio::shm::region_size(ring_capacity, channels, format);
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) < 0) {
+		std::perror("Failed to create shared memory");
+		return 1;
+	}
+
+	void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		std::perror("Failed to map shared memory");
+		shm_unlink(name);
+		return 1;
+	}
+
+	/* Readers only trust the ring once the magic is in place */
+	auto *header = new (map) audio::shm::header();
+	header->version = audio::shm::version;
+	header->sample_rate = rate;
+	header->channels = channels;
+	header->format = format;
+	header->capacity = ring_capacity;
+	header->write_index.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = audio::shm::magic;
+
+	std::signal(SIGINT, stop);
+	std::signal(SIGTERM, stop);
+	std::printf("Writing %u Hz, %u channel %s audio to '%s', Ctrl+C to stop\n", rate, channels,
+				format == audio::shm::SF_F32 ? "float" : "int16", name);
+
+	auto *data = static_cast<uint8_t *>(map) + audio::shm::data_offset;
+	const size_t frame_size = audio::shm::frame_size(channels, format);
+	std::vector<uint8_t> block(block_frames * frame_size);
+	std::vector<float> samples(block_frames * channels);
+	uint64_t written = 0;
+	auto next = std::chrono::steady_clock::now();
+
+	while (running) {
+		size_t frames = block_frames;
+
+		if (from_stdin) {
+			/* stdin is expected to arrive in real time, so it isn't paced */
+			const size_t got = std::fread(block.data(), frame_size, block_frames, stdin);
+			if (got == 0)
+				break;
+			frames = got;
+		} else {
+			for (size_t i = 0; i < frames; i++) {
+				const double t = static_cast<double>(written + i) / rate;
+				for (uint32_t c = 0; c < channels; c++)
+					samples[i * channels + c] = sweep(t, -0.25 * c);
+			}
+
+			if (format == audio::shm::SF_F32) {
+				std::memcpy(block.data(), samples.data(), block.size());
+			} else {
+				auto *out = reinterpret_cast<int16_t *>(block.data());
+				for (size_t i = 0; i < samples.size(); i++)
+					out[i] = static_cast<int16_t>(samples[i] * 32767.f);
+			}
+
+			next += std::chrono::microseconds(1000000ULL * frames / rate);
+			std::this_thread::sleep_until(next);
+		}
+
+		/* Copy in up to two parts, since the block can wrap around the end of the ring */
+		const size_t first = static_cast<size_t>(written & (ring_capacity - 1));
+		const size_t head = std::min<size_t>(frames, ring_capacity - first);
+		std::memcpy(data + first * frame_size, block.data(), head * frame_size);
+		std::memcpy(data, block.data() + head * frame_size, (frames - head) * frame_size);
+
+		written += frames;
+		header->write_index.store(written, std::memory_order_release);
+	}
+
+	munmap(map, size);
+	shm_unlink(name);
+	return 0;
+}
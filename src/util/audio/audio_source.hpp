@@ -17,6 +17,8 @@
  *************************************************************************/
 
 #pragma once
+#include "../../dsp/common.hpp"
+#include <atomic>
 
 #define BUFFER_SIZE 1024
 
@@ -30,6 +32,19 @@ class audio_source {
 protected:
 	source::config *m_cfg;
 
+	/* os_gettime_ns() time the newest sample of the last successful tick was captured, 0 if unknown */
+	uint64_t m_timestamp = 0;
+
+	/* Highest absolute sample since the last take_peak(), in [0, 1] */
+	std::atomic<float> m_peak{0.f};
+
+	/* Called by whichever thread receives the audio */
+	void track_peak(float peak)
+	{
+		if (peak > m_peak.load(std::memory_order_relaxed))
+			m_peak.store(peak, std::memory_order_relaxed);
+	}
+
 public:
 	explicit audio_source(source::config *cfg) : m_cfg(cfg) {}
 
@@ -38,5 +53,23 @@ public:
 	/* obs_source methods */
 	virtual void update() = 0;
 	virtual bool tick(float seconds) = 0;
+
+	/* Cheap housekeeping like (re)binding to the audio, tick() does it too.
+	 * Also run while visualizers sleep, since nothing is ticked then */
+	virtual void maintain() {}
+
+	/* Samples of the last successful tick, if the source can hand out its own
+	 * memory. Otherwise they're in the config buffer and this returns nullptr */
+	virtual const float_stereo_sample *samples() const { return nullptr; }
+
+	/* Frames waiting to be analyzed and the running total of frames thrown away,
+	 * for sources that queue audio on their own. False if there's no queue */
+	virtual bool queue_state(uint64_t *frames_queued, uint64_t *frames_dropped) const { return false; }
+
+	uint64_t timestamp() const { return m_timestamp; }
+
+	/* Peak since the last call, so sleeping visualizers can tell that sound
+	 * came back without reading or analyzing anything */
+	virtual float take_peak() { return m_peak.exchange(0.f, std::memory_order_relaxed); }
 };
 }
@@ -18,9 +18,7 @@
 
 #include "audio_visualizer.hpp"
 #include "../../source/visualizer_source.hpp"
-#include "audio_source.hpp"
-#include "fifo.hpp"
-#include "obs_internal_source.hpp"
+#include "shared_analysis.hpp"
 
 namespace audio {
 
@@ -29,42 +27,19 @@ audio_visualizer::audio_visualizer(source::config *cfg)
 	m_cfg = cfg;
 }
 
-audio_visualizer::~audio_visualizer()
-{
-	delete m_source;
-	m_source = nullptr;
-}
+audio_visualizer::~audio_visualizer() {}
 
 void audio_visualizer::update()
 {
-	if (m_source)
-		m_source->update();
-	if (!m_source || m_cfg->audio_source_name != m_source_id) {
-		m_source_id = m_cfg->audio_source_name;
-		if (m_source)
-			delete m_source;
-		if (m_cfg->audio_source_name.empty() || m_cfg->audio_source_name == std::string(defaults::audio_source)) {
-			m_source = nullptr;
-		} else if (m_cfg->audio_source_name == std::string("mpd")) {
-			m_source = new fifo(m_cfg);
-		} else {
-			m_source = new obs_internal_source(m_cfg);
-		}
+	shared_analysis::key key;
+	if (!shared_analysis::make_key(*m_cfg, &key)) {
+		m_analysis.reset();
+		return;
 	}
-}
 
-void audio_visualizer::tick(float seconds)
-{
-	if (m_source)
-		m_data_read = m_source->tick(seconds);
-	else
-		m_data_read = false;
-
-#ifdef LINUX
-	if (m_cfg->auto_clear && !m_data_read) {
-		/* Clear buffer */
-		memset(m_cfg->buffer, 0, m_cfg->sample_size * sizeof(pcm_stereo_sample));
-	}
-#endif
+	/* Let go of a different input first, a fifo can only have one reader */
+	if (m_analysis && m_analysis->id() != key)
+		m_analysis.reset();
+	m_analysis = shared_analysis::acquire(key, m_cfg);
 }
 }
@@ -18,22 +18,23 @@
 
 #pragma once
 
+#include <cstdint>
 #include <graphics/graphics.h>
-#include <string>
+#include <memory>
 
 namespace source {
+struct settings;
 struct config;
 }
 
 namespace audio {
-class audio_source;
+class shared_analysis;
 
 class audio_visualizer {
 protected:
-	audio::audio_source *m_source = nullptr;
-	source::config *m_cfg = nullptr;
-	std::string m_source_id = "none"; /* where to read audio from */
-	bool m_data_read = false;         /* Audio source will return false if reading failed */
+	/* Audio source and fft, shared with every visualizer reading the same input */
+	std::shared_ptr<shared_analysis> m_analysis;
+	source::config *m_cfg = nullptr; /* only used on the analysis thread */
 
 public:
 	audio_visualizer(source::config *cfg);
@@ -43,8 +44,16 @@ public:
 
 	/* Active is set to true, if the current tick is in sync with the
      * user configured fps */
-	virtual void tick(float seconds);
+	virtual void tick(float seconds) = 0;
 
-	virtual void render(gs_effect_t *effect) = 0;
+	/* Picks up the newest analysis results for render(), false if there
+	 * were none since the last call, so the last drawing is still valid */
+	virtual bool update_frame() = 0;
+
+	/* os_gettime_ns() time the newest sample behind the picked up frame was captured, 0 if unknown */
+	virtual uint64_t frame_timestamp() const { return 0; }
+
+	/* Draws with the settings snapshot render() picked up, the config is the analysis thread's */
+	virtual void render(const source::settings &cfg, gs_effect_t *effect) = 0;
 };
 }
@@ -23,52 +23,84 @@ namespace audio {
 
 bar_visualizer::bar_visualizer(source::config *cfg) : spectrum_visualizer(cfg) {}
 
-void bar_visualizer::render(gs_effect_t *effect)
+bar_visualizer::~bar_visualizer()
 {
-	if (m_cfg->stereo) {
-		size_t i = 0, pos_x = 0;
-		uint32_t height_l, height_r;
-		uint offset = m_cfg->stereo_space / 2;
-		uint center = m_cfg->bar_height / 2 + offset;
+	/* The source deletes visualizers inside the graphics context */
+	gs_vertexbuffer_destroy(m_vertices);
+}
 
-		/* Just in case */
-		if (m_bars_left.size() != m_cfg->detail + DEAD_BAR_OFFSET)
-			m_bars_left.resize(m_cfg->detail + DEAD_BAR_OFFSET, 0.0);
-		if (m_bars_right.size() != m_cfg->detail + DEAD_BAR_OFFSET)
-			m_bars_right.resize(m_cfg->detail + DEAD_BAR_OFFSET, 0.0);
+struct vec3 *bar_visualizer::map_vertices(size_t count)
+{
+	if (count != m_num_vertices || !m_vertices) {
+		gs_vertexbuffer_destroy(m_vertices);
 
-		for (; i < m_bars_left.size() - DEAD_BAR_OFFSET; i++) { /* Leave the four dead bars the end */
-			height_l = UTIL_MAX(static_cast<uint32_t>(round(m_bars_left[i])), 1);
-			height_r = UTIL_MAX(static_cast<uint32_t>(round(m_bars_right[i])), 1);
+		struct gs_vb_data *data = gs_vbdata_create();
+		data->num = count;
+		data->points = static_cast<struct vec3 *>(bzalloc(sizeof(struct vec3) * count));
+		m_vertices = gs_vertexbuffer_create(data, GS_DYNAMIC);
+		m_num_vertices = m_vertices ? count : 0;
+	}
+	return m_vertices ? gs_vertexbuffer_get_data(m_vertices)->points : nullptr;
+}
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
+void bar_visualizer::add_bar(struct vec3 *&points, float x, float y, float width, float height)
+{
+	/* Two triangles per bar */
+	vec3_set(points++, x, y, 0);
+	vec3_set(points++, x + width, y, 0);
+	vec3_set(points++, x, y + height, 0);
+	vec3_set(points++, x + width, y, 0);
+	vec3_set(points++, x + width, y + height, 0);
+	vec3_set(points++, x, y + height, 0);
+}
 
-			/* Top */
-			gs_matrix_push();
-			gs_matrix_translate3f(pos_x, (center - height_l) - offset, 0);
-			gs_draw_sprite(nullptr, 0, m_cfg->bar_width, height_l);
-			gs_matrix_pop();
+void bar_visualizer::render(const source::settings &cfg, gs_effect_t *effect)
+{
+	const auto &frame = m_frames.front();
+	size_t bar_count = cfg.stereo ? UTIL_MIN(frame.left.size(), frame.right.size()) : frame.left.size();
 
+	/* Just in case */
+	if (bar_count <= DEAD_BAR_OFFSET)
+		return;
+	bar_count -= DEAD_BAR_OFFSET; /* Leave the four dead bars the end */
+
+	const size_t num_vertices = bar_count * 6 * (cfg.stereo ? 2 : 1);
+	auto *points = map_vertices(num_vertices);
+	if (!points)
+		return;
+
+	const auto width = static_cast<float>(cfg.bar_width);
+	if (cfg.stereo) {
+		uint32_t height_l, height_r;
+		uint offset = cfg.stereo_space / 2;
+		uint center = cfg.bar_height / 2 + offset;
+
+		for (size_t i = 0; i < bar_count; i++) {
+			height_l = UTIL_MAX(static_cast<uint32_t>(round(frame.left[i])), 1);
+			height_r = UTIL_MAX(static_cast<uint32_t>(round(frame.right[i])), 1);
+
+			const auto pos_x = static_cast<float>(i * (cfg.bar_width + cfg.bar_space));
+
+			/* Top */
+			add_bar(points, pos_x, static_cast<float>(center) - height_l - offset, width, height_l);
 			/* Bottom */
-			gs_matrix_push();
-			gs_matrix_translate3f(pos_x, center + offset, 0);
-			gs_draw_sprite(nullptr, 0, m_cfg->bar_width, height_r);
-			gs_matrix_pop();
+			add_bar(points, pos_x, static_cast<float>(center + offset), width, height_r);
 		}
 	} else {
-		size_t i = 0, pos_x = 0;
 		uint32_t height;
-		for (; i < m_bars_left.size() - DEAD_BAR_OFFSET; i++) { /* Leave the four dead bars the end */
-			auto val = m_bars_left[i];
-			height = UTIL_MAX(static_cast<uint32_t>(round(val)), 1);
-
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_matrix_push();
-			gs_matrix_translate3f(pos_x, (m_cfg->bar_height - height), 0);
-			gs_draw_sprite(nullptr, 0, m_cfg->bar_width, height);
-			gs_matrix_pop();
+		for (size_t i = 0; i < bar_count; i++) {
+			height = UTIL_MAX(static_cast<uint32_t>(round(frame.left[i])), 1);
+
+			const auto pos_x = static_cast<float>(i * (cfg.bar_width + cfg.bar_space));
+			add_bar(points, pos_x, static_cast<float>(cfg.bar_height) - height, width, height);
 		}
 	}
+
+	gs_vertexbuffer_flush(m_vertices);
+	gs_load_vertexbuffer(m_vertices);
+	gs_load_indexbuffer(nullptr);
+	gs_draw(GS_TRIS, 0, static_cast<uint32_t>(num_vertices));
+	gs_load_vertexbuffer(nullptr);
 	UNUSED_PARAMETER(effect);
 }
 }
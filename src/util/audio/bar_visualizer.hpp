@@ -21,8 +21,17 @@
 
 namespace audio {
 class bar_visualizer : public spectrum_visualizer {
+	/* All bars are written into this as quads and drawn at once,
+	 * it's only recreated if the number of vertices changes */
+	gs_vertbuffer_t *m_vertices = nullptr;
+	size_t m_num_vertices = 0;
+
+	struct vec3 *map_vertices(size_t count);
+	static void add_bar(struct vec3 *&points, float x, float y, float width, float height);
+
 public:
 	explicit bar_visualizer(source::config *cfg);
-	void render(gs_effect_t *effect) override;
+	~bar_visualizer() override;
+	void render(const source::settings &cfg, gs_effect_t *effect) override;
 };
 }
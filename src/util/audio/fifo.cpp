@@ -19,92 +19,195 @@
 #ifdef LINUX
 #include "fifo.hpp"
 #include "../../source/visualizer_source.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 #include <util/platform.h>
 
-#define MAX_READ_ATTEMPTS 100
-#define READ_ATTEMPT_SLEEP 1L * 1000000L
+#define FIFO_RING_FRAMES 16384 /* ~340ms at 48kHz */
+#define RECONNECT_DELAY_MS 100
 
 namespace audio {
 
-fifo::fifo(source::config *cfg) : audio_source(cfg)
+fifo::fifo(source::config *cfg) : audio_source(cfg), m_ring(FIFO_RING_FRAMES)
 {
 	update();
 }
 
 fifo::~fifo()
 {
-	if (m_fifo_fd)
-		close(m_fifo_fd);
-	m_fifo_fd = 0;
+	stop_reader();
 }
 
 void fifo::update()
 {
-	m_file_path = m_cfg->fifo_path;
-	open_fifo();
+	const std::string &path = m_cfg->fifo_path;
+	if (path == m_file_path && m_reader.joinable())
+		return;
+
+	stop_reader();
+	m_file_path = path;
+	start_reader();
 }
 
 bool fifo::tick(float seconds)
 {
-	if (m_fifo_fd < 0 && !open_fifo())
-		return false;
+	const size_t frames = m_cfg->sample_size;
+	if (m_pcm.size() != frames)
+		m_pcm.assign(frames, pcm_stereo_sample{0, 0});
 
-	auto buffer_size_bytes = static_cast<size_t>(sizeof(pcm_stereo_sample) * m_cfg->sample_size);
-	size_t bytes_left = buffer_size_bytes;
-	auto attempts = 0;
-	memset(m_cfg->buffer, 0, buffer_size_bytes);
-
-	while (bytes_left > 0) {
-		int64_t bytes_read = read(m_fifo_fd, m_cfg->buffer, bytes_left);
-
-		if (bytes_read == 0) {
-			debug("Could not read any bytes");
-			return false;
-		} else if (bytes_read == -1) {
-			if (errno == EAGAIN) {
-				if (attempts > MAX_READ_ATTEMPTS) {
-					debug("Couldn't finish reading buffer, bytes read: %d,"
-						  "buffer size: %d",
-						  bytes_read, buffer_size_bytes);
-					memset(m_cfg->buffer, 0, buffer_size_bytes);
-					close(m_fifo_fd);
-					m_fifo_fd = -1;
-					return false;
-				}
-				/* TODO: Sleep? Would delay thread */
-				++attempts;
-			} else {
-				debug("Error reading file: %d %s", errno, strerror(errno));
-			}
-		} else {
-			bytes_left -= (size_t)bytes_read;
+	/* mpd's clock drifts against ours and the fps rarely divides the sample rate,
+	 * so a backlog can build up. Up to the latency budget it's consumed one frame's
+	 * worth at a time, anything past that is skipped to show the newest window */
+	const size_t budget = static_cast<size_t>(m_cfg->fifo_latency) * m_cfg->sample_rate / 1000;
+	size_t available = m_ring.size();
+	if (available > frames + budget) {
+		m_ring.skip(available - frames);
+		available = frames;
+	}
+	available = std::min(available, frames);
+
+	if (m_ring.overflowed() != m_last_overflowed || m_ring.skipped() != m_last_skipped) {
+		m_last_overflowed = m_ring.overflowed();
+		m_last_skipped = m_ring.skipped();
+		debug("Fifo buffer dropped %llu frames on overflow, skipped %llu stale frames, %llu frames queued",
+			  (unsigned long long)m_last_overflowed, (unsigned long long)m_last_skipped,
+			  (unsigned long long)queue_depth());
+	}
+
+	if (!available) {
+		/* One late tick just repeats the last window, after that mpd
+		 * probably stopped, so the bars are allowed to fall */
+		if (++m_missed_ticks > 1) {
+			std::fill(m_pcm.begin(), m_pcm.end(), pcm_stereo_sample{0, 0});
+			memset(m_cfg->buffer, 0, sizeof(float_stereo_sample) * frames);
 		}
+		return false;
 	}
+	m_missed_ticks = 0;
+
+	/* Slide the window by however much arrived since the last tick, so a
+	 * writer that's a bit late doesn't cause a gap in the visualization */
+	std::copy(m_pcm.begin() + available, m_pcm.end(), m_pcm.begin());
+	m_ring.pop(m_pcm.data() + (frames - available), available);
 
+	const float scale = 1.f / static_cast<float>(constants::sample_scale);
+	for (size_t i = 0; i < frames; i++) {
+		m_cfg->buffer[i].l = m_pcm[i].l * scale;
+		m_cfg->buffer[i].r = m_pcm[i].r * scale;
+	}
 	return true;
 }
 
-bool fifo::open_fifo()
+void fifo::start_reader()
+{
+	if (m_file_path.empty())
+		return;
+
+	if (pipe2(m_wakeup, O_CLOEXEC) < 0) {
+		warn("Failed to create fifo wakeup pipe: %s", strerror(errno));
+		m_wakeup[0] = m_wakeup[1] = -1;
+		return;
+	}
+
+	m_stop.store(false);
+	m_reader = std::thread(&fifo::read_loop, this, m_file_path);
+}
+
+void fifo::stop_reader()
+{
+	if (!m_reader.joinable())
+		return;
+
+	m_stop.store(true);
+	const char wake = 1;
+	if (write(m_wakeup[1], &wake, 1) < 0)
+		warn("Failed to wake up fifo reader: %s", strerror(errno));
+	m_reader.join();
+
+	close(m_wakeup[0]);
+	close(m_wakeup[1]);
+	m_wakeup[0] = m_wakeup[1] = -1;
+}
+
+bool fifo::wait_for_wakeup(int timeout_ms)
 {
-	if (m_fifo_fd)
-		close(m_fifo_fd);
-
-	if (m_file_path && strlen(m_file_path) > 0) {
-		m_fifo_fd = open(m_file_path, O_RDONLY);
-
-		if (m_fifo_fd < 0) {
-			warn("Failed to open fifo '%s'", m_file_path);
-		} else {
-			auto flags = fcntl(m_fifo_fd, F_GETFL, 0);
-			auto ret = fcntl(m_fifo_fd, F_SETFL, flags | O_NONBLOCK);
-			if (ret < 0)
-				warn("Failed to set fifo flags!");
-			return ret >= 0;
+	pollfd fd = {m_wakeup[0], POLLIN, 0};
+	return poll(&fd, 1, timeout_ms) > 0;
+}
+
+void fifo::read_loop(const std::string &path)
+{
+	uint8_t bytes[4096];
+	bool warned = false;
+
+	while (!m_stop.load()) {
+		/* Opening without O_NONBLOCK would block until mpd opens the fifo
+		 * for writing, and then there'd be no way to stop this thread */
+		int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) {
+			if (!warned)
+				warn("Failed to open fifo '%s': %s", path.c_str(), strerror(errno));
+			warned = true;
+			wait_for_wakeup(RECONNECT_DELAY_MS * 10);
+			continue;
 		}
+
+		debug("Opened fifo '%s'", path.c_str());
+		warned = false;
+		size_t partial = 0; /* bytes of an incomplete sample left from the last read */
+		pollfd fds[2] = {{fd, POLLIN, 0}, {m_wakeup[0], POLLIN, 0}};
+
+		while (!m_stop.load()) {
+			if (poll(fds, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				warn("Failed to poll fifo: %s", strerror(errno));
+				break;
+			}
+			if (fds[1].revents)
+				break;
+			if (!fds[0].revents)
+				continue;
+
+			auto bytes_read = read(fd, bytes + partial, sizeof(bytes) - partial);
+			if (bytes_read < 0) {
+				if (errno == EAGAIN || errno == EINTR)
+					continue;
+				debug("Error reading fifo: %d %s", errno, strerror(errno));
+				break;
+			} else if (bytes_read == 0) {
+				/* mpd closed its end, e.g. when playback was stopped */
+				debug("Fifo writer disconnected, reopening");
+				break;
+			}
+
+			int pending = 0;
+			if (ioctl(fd, FIONREAD, &pending) == 0)
+				m_pipe_frames.store(static_cast<size_t>(pending) / sizeof(pcm_stereo_sample),
+									std::memory_order_relaxed);
+
+			const size_t total = partial + static_cast<size_t>(bytes_read);
+			const size_t count = total / sizeof(pcm_stereo_sample);
+			int peak = 0;
+			m_ring.push(count, [&bytes, &peak](pcm_stereo_sample &s, size_t i) {
+				memcpy(&s, bytes + i * sizeof(pcm_stereo_sample), sizeof(pcm_stereo_sample));
+				peak = std::max(peak, std::max(std::abs(int(s.l)), std::abs(int(s.r))));
+			});
+			track_peak(peak / static_cast<float>(constants::sample_scale));
+			partial = total - count * sizeof(pcm_stereo_sample);
+			memmove(bytes, bytes + count * sizeof(pcm_stereo_sample), partial);
+		}
+
+		close(fd);
+		m_pipe_frames.store(0, std::memory_order_relaxed);
+		/* Don't spin if the writer keeps going away */
+		if (!m_stop.load())
+			wait_for_wakeup(RECONNECT_DELAY_MS);
 	}
-	return false;
 }
 } /* namespace audio */
 #endif /* LINUX */
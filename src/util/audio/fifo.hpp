@@ -16,21 +16,54 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *************************************************************************/
 
+#include "../spsc_ring.hpp"
+#include "../util.hpp"
 #include "audio_source.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace audio {
 class fifo : public audio_source {
 #ifdef LINUX
 private:
-	const char *m_file_path = nullptr;
-	int m_fifo_fd = 0;
-	bool open_fifo();
+	std::string m_file_path;
+	std::vector<pcm_stereo_sample> m_pcm; /* newest window of raw int16 samples as written by mpd */
+	uint64_t m_last_overflowed = 0, m_last_skipped = 0;
+	uint32_t m_missed_ticks = 0;
+
+	/* The reader thread blocks in poll() on the fifo and a wakeup pipe,
+	 * which is written to when the thread has to stop */
+	std::thread m_reader;
+	std::atomic<bool> m_stop{false};
+	int m_wakeup[2] = {-1, -1};
+	util::spsc_ring<pcm_stereo_sample> m_ring;
+	std::atomic<size_t> m_pipe_frames{0}; /* still in the pipe, as of the last read */
+
+	void start_reader();
+	void stop_reader();
+	void read_loop(const std::string &path);
+	bool wait_for_wakeup(int timeout_ms);
 
 public:
 	fifo(source::config *cfg);
 	~fifo() override;
 	void update() override;
 	bool tick(float seconds) override;
+
+	/* Frames written by mpd that haven't been analyzed yet */
+	size_t queue_depth() const { return m_ring.size() + m_pipe_frames.load(std::memory_order_relaxed); }
+
+	/* Frames thrown away, either because the ring was full or to stay within the latency budget */
+	uint64_t dropped() const { return m_ring.overflowed() + m_ring.skipped(); }
+
+	bool queue_state(uint64_t *frames_queued, uint64_t *frames_dropped) const override
+	{
+		*frames_queued = queue_depth();
+		*frames_dropped = dropped();
+		return true;
+	}
 #else  /* Stubs on Windows */
 public:
 	fifo(source::config *cfg) : audio_source(cfg) {}
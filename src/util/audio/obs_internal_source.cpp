@@ -18,10 +18,14 @@
 
 #include "obs_internal_source.hpp"
 #include "../../source/visualizer_source.hpp"
+#include <algorithm>
+#include <cmath>
 #include <util/platform.h>
 
 #define DEFAULT_AUDIO_BUF_MS 10
 #define MS_IN_S 100
+#define CAPTURE_RING_FRAMES 16384 /* ~340ms at 48kHz */
+#define CAPTURE_RING_STAMPS 256   /* more callbacks than the frames can hold */
 
 namespace audio {
 
@@ -32,10 +36,9 @@ static void audio_capture(void *param, obs_source_t *src, const struct audio_dat
 		s->capture(src, data, muted);
 }
 
-obs_internal_source::obs_internal_source(source::config *cfg) : audio_source(cfg)
+obs_internal_source::obs_internal_source(source::config *cfg) : audio_source(cfg), m_audio_data(CAPTURE_RING_FRAMES),
+	  m_stamps(CAPTURE_RING_STAMPS)
 {
-	circlebuf_init(&m_audio_data[0]);
-	circlebuf_init(&m_audio_data[1]);
 	update();
 }
 
@@ -50,53 +53,51 @@ obs_internal_source::~obs_internal_source()
 		}
 		obs_weak_source_release(m_capture_source);
 	}
-
-	for (size_t i = 0; i < 2; i++) {
-		circlebuf_free(&m_audio_data[i]);
-		bfree(m_audio_buf[i]);
-	}
 }
 
 void obs_internal_source::capture(obs_source_t *src, const struct audio_data *data, bool muted)
 {
-	m_cfg->value_mutex.lock();
-
-	if (m_max_capture_frames < data->frames)
-		m_max_capture_frames = data->frames;
-
-	size_t expected = m_max_capture_frames * sizeof(float);
-
-	if (expected) {
-		if (m_audio_data[0].size > expected * 2) {
-			for (auto &buf : m_audio_data) {
-				circlebuf_pop_front(&buf, nullptr, expected);
-			}
-		}
+	/* Runs on the audio thread, so no locking in here. Stale data
+	 * is thrown away by tick() */
+	if (m_max_capture_frames.load(std::memory_order_relaxed) < data->frames)
+		m_max_capture_frames.store(data->frames, std::memory_order_relaxed);
+
+	auto channels = m_num_channels.load(std::memory_order_relaxed);
+	auto *left = reinterpret_cast<const float *>(data->data[0]);
+	auto *right = channels > 1 ? reinterpret_cast<const float *>(data->data[1]) : nullptr;
+
+	const size_t position = m_audio_data.pushed();
+	size_t written;
+	if (muted || !left) {
+		written = m_audio_data.push(data->frames, [](float_stereo_sample &s, size_t) { s.l = s.r = 0.f; });
+	} else {
+		float peak = 0.f;
+		written = m_audio_data.push(data->frames, [left, right, &peak](float_stereo_sample &s, size_t i) {
+			s.l = left[i];
+			s.r = right ? right[i] : 0.f;
+			peak = std::max(peak, std::max(std::fabs(s.l), std::fabs(s.r)));
+		});
+		track_peak(peak);
+	}
 
-		if (muted) {
-			for (size_t i = 0; i < UTIL_MIN(m_num_channels, 2); i++) {
-				circlebuf_push_back_zero(&m_audio_data[i], data->frames * sizeof(float));
-			}
-		} else {
-			for (size_t i = 0; i < UTIL_MIN(m_num_channels, 2); i++) {
-				circlebuf_push_back(&m_audio_data[i], data->data[i], data->frames * sizeof(float));
-			}
-		}
+	/* Lets tick() tell how old the samples it reads are */
+	if (written) {
+		const uint64_t timestamp = data->timestamp;
+		m_stamps.push(1, [position, written, timestamp](capture_stamp &s, size_t) {
+			s.position = position;
+			s.frames = written;
+			s.timestamp = timestamp;
+		});
 	}
 
 #ifdef LINUX
-	if (m_cfg->auto_clear)
-		m_last_capture = os_gettime_ns();
+	if (m_auto_clear.load(std::memory_order_relaxed))
+		m_last_capture.store(os_gettime_ns(), std::memory_order_relaxed);
 #endif
-	m_cfg->value_mutex.unlock();
 }
 
-bool obs_internal_source::tick(float seconds)
+void obs_internal_source::maintain()
 {
-	/* Audio capturing is done in separate callback
-     * and is technically only done, once the circle buffer is
-     * filled, but we'll just assume that's always the case */
-
 	/* Update / refresh audio capturing */
 	std::string new_name = "";
 	if (!m_capture_name.empty() && !m_capture_source) {
@@ -124,49 +125,60 @@ bool obs_internal_source::tick(float seconds)
 			obs_source_release(capture);
 		}
 	}
+}
+
+bool obs_internal_source::tick(float seconds)
+{
+	/* Audio capturing is done in separate callback
+     * and is technically only done, once the circle buffer is
+     * filled, but we'll just assume that's always the case */
+	maintain();
 
 	/* Copy captured data */
-	size_t data_size = m_audio_buf_len * sizeof(float);
-	if (!data_size) {
+	if (!m_audio_buf_len) {
 		debug("Buffer is empty");
 		return false;
 	}
 
-	if (m_audio_data[0].size < data_size) {
-		/* Clear buffers */
-		memset(m_audio_buf[0], 0, data_size);
-		memset(m_audio_buf[1], 0, data_size);
-		debug("No Data in circle buffer");
-		return false;
-	} else {
-		/* Otherwise copy & convert */
-		for (size_t i = 0; i < UTIL_MIN(m_num_channels, 2); i++) {
-			circlebuf_pop_front(&m_audio_data[i], m_audio_buf[i], data_size);
-		}
+	/* Don't let the capture buffer run ahead by more than two callbacks,
+	 * anything older than that would only add latency */
+	size_t expected = UTIL_MAX(m_max_capture_frames.load(std::memory_order_relaxed), m_audio_buf_len);
+	size_t available = m_audio_data.size();
+	if (available > expected * 2)
+		m_audio_data.skip(available - expected * 2);
+
+	if (m_audio_data.overflowed() != m_last_overflowed || m_audio_data.skipped() != m_last_skipped) {
+		m_last_overflowed = m_audio_data.overflowed();
+		m_last_skipped = m_audio_data.skipped();
+		debug("Capture buffer dropped %llu frames on overflow, skipped %llu stale frames",
+			  (unsigned long long)m_last_overflowed, (unsigned long long)m_last_skipped);
+	}
 
-		/* Convert to int16 */
-		for (size_t chan = 0; chan < UTIL_MIN(m_num_channels, 2); chan++) {
-			if (!m_audio_buf[chan])
-				continue;
-
-			for (uint32_t i = 0; i < m_audio_buf_len; i++) {
-				if (chan == 0) {
-					m_cfg->buffer[i].l = static_cast<int16_t>(m_audio_buf[chan][i] * (UINT16_MAX / 2));
-				} else {
-					m_cfg->buffer[i].r = static_cast<int16_t>(m_audio_buf[chan][i] * (UINT16_MAX / 2));
-				}
-			}
-		}
+	if (m_audio_data.size() < m_audio_buf_len) {
+		debug("No Data in capture buffer");
+		return false;
 	}
 
+	/* Samples are already float, so they go straight into the buffer */
+	m_audio_data.pop(m_cfg->buffer, m_audio_buf_len);
+	update_timestamp();
 	return true;
 }
 
-void obs_internal_source::resize_audio_buf(size_t new_len)
+void obs_internal_source::update_timestamp()
 {
-	m_audio_buf_len = new_len;
-	m_audio_buf[0] = static_cast<float *>(brealloc(m_audio_buf[0], new_len * sizeof(float)));
-	m_audio_buf[1] = static_cast<float *>(brealloc(m_audio_buf[1], new_len * sizeof(float)));
+	/* Find the callback the newest sample that was read came from, older ones aren't needed anymore */
+	const size_t newest = m_audio_data.consumed() - 1;
+	while (const auto *stamp = m_stamps.front()) {
+		if (stamp->position > newest)
+			break;
+		m_stamps.pop(&m_stamp, 1);
+	}
+
+	if (newest >= m_stamp.position && newest - m_stamp.position < m_stamp.frames && m_cfg->sample_rate)
+		m_timestamp = m_stamp.timestamp + (newest - m_stamp.position) * 1000000000ULL / m_cfg->sample_rate;
+	else
+		m_timestamp = 0;
 }
 
 void obs_internal_source::update()
@@ -177,7 +189,8 @@ void obs_internal_source::update()
      * and therefore will break the visualizer so I'll just use 60 as a constant here
      */
 	m_cfg->sample_size = m_cfg->sample_rate / 60;
-	m_num_channels = audio_output_get_channels(obs_get_audio());
+	m_num_channels.store(audio_output_get_channels(obs_get_audio()), std::memory_order_relaxed);
+	m_auto_clear.store(m_cfg->auto_clear, std::memory_order_relaxed);
 	obs_weak_source_t *old = nullptr;
 
 	if (m_cfg->audio_source_name.empty()) {
@@ -207,8 +220,7 @@ void obs_internal_source::update()
 		obs_weak_source_release(old);
 	}
 
-	if (m_audio_buf_len != m_cfg->sample_size)
-		resize_audio_buf(m_cfg->sample_size);
+	m_audio_buf_len = m_cfg->sample_size;
 }
 
 }
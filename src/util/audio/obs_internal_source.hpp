@@ -17,37 +17,54 @@
  *************************************************************************/
 
 #pragma once
+#include "../spsc_ring.hpp"
+#include "../util.hpp"
 #include "audio_source.hpp"
+#include <atomic>
 #include <media-io/audio-io.h>
-#include <mutex>
 #include <obs-module.h>
-#include <util/circlebuf.h>
+#include <string>
 
 namespace audio {
 
 class obs_internal_source : public audio_source {
 	std::string m_capture_name = "";
 	obs_weak_source_t *m_capture_source = nullptr;
-	size_t m_max_capture_frames = 0;
-	uint8_t m_num_channels = 0;
 	uint64_t m_capture_check_time = 0;
-	circlebuf m_audio_data[2]; /* Left & Right data from capture callback */
-	float *m_audio_buf[2]{};   /* Copy of captured audio */
-	size_t m_audio_buf_len = 0;
+
+	/* Shared with the audio thread, which must never block */
+	std::atomic<size_t> m_max_capture_frames{0};
+	std::atomic<uint8_t> m_num_channels{0};
+	std::atomic<bool> m_auto_clear{false};
+	util::spsc_ring<float_stereo_sample> m_audio_data; /* Interleaved data from capture callback */
+
+	/* Where each callback's frames start in m_audio_data and when they were captured */
+	struct capture_stamp {
+		size_t position;
+		size_t frames;
+		uint64_t timestamp;
+	};
+	util::spsc_ring<capture_stamp> m_stamps;
+	capture_stamp m_stamp{0, 0, 0}; /* of the callback the last read sample came from */
+	uint64_t m_last_overflowed = 0, m_last_skipped = 0;
+
+	size_t m_audio_buf_len = 0; /* Frames copied into the config buffer per tick */
+
+	void update_timestamp();
 #ifdef LINUX
 	/* Used to keep track of last audio capture callback to decide
 	 * whether audio playback has stopped to clear the buffer.
 	 * This usually is needed when JACK is used
 	 */
-	uint64_t m_last_capture = 0;
+	std::atomic<uint64_t> m_last_capture{0};
 #endif
-	void resize_audio_buf(size_t new_len);
 
 public:
 	obs_internal_source(source::config *cfg);
 	~obs_internal_source() override;
 
 	bool tick(float seconds) override;
+	void maintain() override;
 	void update() override;
 
 	void capture(obs_source_t *src, const struct audio_data *data, bool muted);
@@ -0,0 +1,199 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "shared_analysis.hpp"
+#include "fifo.hpp"
+#include "obs_internal_source.hpp"
+#include "shm_source.hpp"
+#include <map>
+#include <tuple>
+
+namespace audio {
+
+namespace {
+std::mutex registry_mutex;
+std::map<shared_analysis::key, std::weak_ptr<shared_analysis>> registry;
+}
+
+bool shared_analysis::key::operator<(const key &o) const
+{
+	return std::tie(input, sample_rate, transform.sample_size, transform.window_size, transform.window,
+					transform.stereo) < std::tie(o.input, o.sample_rate, o.transform.sample_size,
+												  o.transform.window_size, o.transform.window, o.transform.stereo);
+}
+
+shared_analysis::shared_analysis(const key &k, const source::config &cfg) : m_key(k)
+{
+	m_cfg.audio_source_name = cfg.audio_source_name;
+	m_cfg.sample_rate = cfg.sample_rate;
+	m_cfg.sample_size = cfg.sample_size;
+	m_cfg.fps = cfg.fps;
+	m_cfg.fifo_path = cfg.fifo_path;
+	m_cfg.shm_name = cfg.shm_name;
+	m_cfg.fifo_latency = cfg.fifo_latency;
+	m_cfg.auto_clear = cfg.auto_clear;
+
+	/* Sources adjust the sample rate and size to what they deliver */
+	if (m_cfg.audio_source_name == "mpd")
+		m_source = new fifo(&m_cfg);
+	else if (m_cfg.audio_source_name == "shm")
+		m_source = new shm_source(&m_cfg);
+	else
+		m_source = new obs_internal_source(&m_cfg);
+
+	m_buffer.assign(m_cfg.sample_size, float_stereo_sample{0.f, 0.f});
+	m_cfg.buffer = m_buffer.data();
+
+	auto transform = k.transform;
+	transform.sample_size = m_cfg.sample_size;
+	m_transform.configure(transform);
+}
+
+shared_analysis::~shared_analysis()
+{
+	delete m_source;
+}
+
+void shared_analysis::apply(const source::config &cfg)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	/* Not part of the key, so the visualizer updated last decides */
+	m_cfg.fifo_latency = cfg.fifo_latency;
+	m_cfg.auto_clear = cfg.auto_clear;
+	m_source->update();
+
+	if (m_cfg.sample_size != m_buffer.size()) {
+		m_buffer.assign(m_cfg.sample_size, float_stereo_sample{0.f, 0.f});
+		m_cfg.buffer = m_buffer.data();
+		auto transform = m_transform.settings();
+		transform.sample_size = m_cfg.sample_size;
+		m_transform.configure(transform);
+		m_input_ready = false;
+	}
+}
+
+bool shared_analysis::make_key(const source::config &cfg, key *k)
+{
+	if (cfg.audio_source_name.empty() || cfg.audio_source_name == defaults::audio_source)
+		return false;
+
+	k->input = cfg.audio_source_name;
+	if (k->input == "mpd")
+		k->input += std::string(":") + cfg.fifo_path;
+	else if (k->input == "shm")
+		k->input += std::string(":") + cfg.shm_name;
+	k->sample_rate = cfg.sample_rate;
+	k->transform.sample_size = cfg.sample_size;
+	k->transform.window_size = cfg.window_size;
+	k->transform.window = cfg.window;
+	k->transform.stereo = cfg.stereo;
+	return true;
+}
+
+std::shared_ptr<shared_analysis> shared_analysis::acquire(const key &k, source::config *cfg)
+{
+	std::shared_ptr<shared_analysis> analysis;
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for (auto it = registry.begin(); it != registry.end();) {
+			if (it->second.expired())
+				it = registry.erase(it);
+			else
+				++it;
+		}
+
+		auto &entry = registry[k];
+		analysis = entry.lock();
+		if (!analysis) {
+			analysis = std::make_shared<shared_analysis>(k, *cfg);
+			entry = analysis;
+		}
+	}
+
+	analysis->apply(*cfg);
+	cfg->sample_rate = analysis->m_cfg.sample_rate;
+	cfg->sample_size = analysis->m_cfg.sample_size;
+	return analysis;
+}
+
+std::unique_lock<std::mutex> shared_analysis::begin(uint64_t frame_time, float seconds, util::stage_stats *stats)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	/* A visualizer that fell behind reuses the newer input instead of reading the next frame's audio */
+	if (m_input_ready && frame_time <= m_frame_time)
+		return lock;
+
+	m_frame_time = frame_time;
+	update_peak(frame_time);
+	bool data_read;
+	{
+		util::stage_timer timer(stats, util::ST_CAPTURE);
+		data_read = m_source->tick(seconds);
+	}
+
+	uint64_t queued, dropped;
+	if (stats && m_source->queue_state(&queued, &dropped))
+		stats->record_queue(queued, dropped);
+
+#ifdef LINUX
+	if (m_cfg.auto_clear && !data_read)
+		memset(m_cfg.buffer, 0, m_cfg.sample_size * sizeof(float_stereo_sample));
+#endif
+
+	/* Sources that hand out their own memory are analyzed in place */
+	const float_stereo_sample *samples = data_read ? m_source->samples() : nullptr;
+	m_timestamp = data_read ? m_source->timestamp() : 0;
+	util::stage_timer timer(stats, util::ST_CONVERT);
+	m_input_ready = m_transform.prepare_input(samples ? samples : m_cfg.buffer);
+	m_transformed = false;
+	return lock;
+}
+
+void shared_analysis::update_peak(uint64_t frame_time)
+{
+	/* Taken once per frame, so every visualizer sees the same value */
+	if (frame_time > m_peak_frame_time) {
+		m_peak_frame_time = frame_time;
+		m_peak = m_source->take_peak();
+	}
+}
+
+float shared_analysis::peak(uint64_t frame_time)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	/* Sleeping visualizers don't tick the source, so it still gets to rebind or reattach here */
+	if (frame_time > m_peak_frame_time)
+		m_source->maintain();
+	update_peak(frame_time);
+	return m_peak;
+}
+
+const dsp::spectrum_transform *shared_analysis::spectrum(util::stage_stats *stats)
+{
+	if (!m_input_ready)
+		return nullptr;
+	if (!m_transformed) {
+		util::stage_timer timer(stats, util::ST_FFT);
+		m_have_spectrum = m_transform.transform();
+		m_transformed = true;
+	}
+	return m_have_spectrum ? &m_transform : nullptr;
+}
+
+}
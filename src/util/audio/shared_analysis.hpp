@@ -0,0 +1,96 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "../../dsp/spectrum_transform.hpp"
+#include "../../source/visualizer_source.hpp"
+#include "../stage_stats.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace audio {
+class audio_source;
+
+/* One audio source and one fft for every distinct input, shared by all
+ * visualizers that read it. They only turn the spectrum into bars, so
+ * putting the same source into more scenes doesn't cost another fft */
+class shared_analysis {
+public:
+	/* Everything that makes two visualizers see the same spectrum */
+	struct key {
+		std::string input; /* source name, with the fifo path or shm name for those */
+		uint32_t sample_rate;
+		dsp::transform_settings transform;
+
+		bool operator<(const key &o) const;
+		bool operator==(const key &o) const
+		{
+			return input == o.input && sample_rate == o.sample_rate && transform == o.transform;
+		}
+		bool operator!=(const key &o) const { return !(*this == o); }
+	};
+
+private:
+	key m_key;
+	std::mutex m_mutex;
+	source::config m_cfg; /* what the audio source reads its settings from */
+	std::vector<float_stereo_sample> m_buffer;
+	audio_source *m_source = nullptr;
+	dsp::spectrum_transform m_transform;
+
+	/* State of the current frame */
+	uint64_t m_frame_time = 0, m_peak_frame_time = 0;
+	uint64_t m_timestamp = 0;
+	float m_peak = 0.f;
+	bool m_input_ready = false, m_transformed = false, m_have_spectrum = false;
+
+	void update_peak(uint64_t frame_time);
+
+	void apply(const source::config &cfg);
+
+public:
+	shared_analysis(const key &k, const source::config &cfg);
+	~shared_analysis();
+
+	/* Key for the current settings of cfg, false if no audio source is selected */
+	static bool make_key(const source::config &cfg, key *k);
+
+	/* The analysis for k, which is shared if another visualizer already uses it.
+	 * Sample rate and size are decided by the audio source, so they're written back to cfg */
+	static std::shared_ptr<shared_analysis> acquire(const key &k, source::config *cfg);
+
+	const key &id() const { return m_key; }
+
+	/* Locks the analysis, the first call for a newer frame_time reads the audio.
+	 * Work that actually runs is timed into stats, if there are any */
+	std::unique_lock<std::mutex> begin(uint64_t frame_time, float seconds, util::stage_stats *stats);
+
+	/* Highest sample that arrived for frame_time, without reading or analyzing the audio */
+	float peak(uint64_t frame_time);
+
+	/* Only while locked by begin() */
+	const dsp::spectrum_transform &input() const { return m_transform; }
+	/* When the newest sample of the input was captured, 0 if the source can't tell */
+	uint64_t timestamp() const { return m_timestamp; }
+	/* Runs the fft at most once per frame, nullptr if there's no input or no plan yet */
+	const dsp::spectrum_transform *spectrum(util::stage_stats *stats);
+};
+
+}
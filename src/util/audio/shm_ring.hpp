@@ -0,0 +1,63 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* Layout of the POSIX shared memory ring the shm audio source reads from.
+ * It's written by an external process, src/tools/shm_writer.cpp is a
+ * reference writer. Kept free of obs headers so writers can include it */
+namespace audio {
+namespace shm {
+
+const uint32_t magic = 0x54435053; /* "SPCT" */
+const uint32_t version = 1;
+
+enum sample_format : uint32_t { SF_S16 = 0, SF_F32 = 1 };
+
+struct header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sample_rate;
+	uint32_t channels; /* 1 or 2, interleaved */
+	uint32_t format;   /* sample_format */
+	uint32_t capacity; /* in frames, has to be a power of two */
+
+	/* Number of frames written so far, frame i is stored at i & (capacity - 1).
+	 * The writer stores this with release semantics after the frames are in place */
+	alignas(64) std::atomic<uint64_t> write_index;
+};
+
+/* Samples start here, so they're aligned for SIMD loads */
+const size_t data_offset = 128;
+static_assert(sizeof(header) <= data_offset, "shm header doesn't fit in front of the samples");
+
+inline size_t frame_size(uint32_t channels, uint32_t format)
+{
+	return channels * (format == SF_F32 ? sizeof(float) : sizeof(int16_t));
+}
+
+inline size_t region_size(uint32_t capacity, uint32_t channels, uint32_t format)
+{
+	return data_offset + static_cast<size_t>(capacity) * frame_size(channels, format);
+}
+
+}
+}
@@ -0,0 +1,238 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#ifdef LINUX
+#include "shm_source.hpp"
+#include "../../source/visualizer_source.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/platform.h>
+
+#define ATTACH_RETRY_NS 3000000000ULL
+#define IDLE_NS 100000000ULL           /* no new frames for this long counts as silence */
+#define STALL_TIMEOUT_NS 3000000000ULL /* writer is assumed gone after this */
+
+namespace audio {
+
+shm_source::shm_source(source::config *cfg) : audio_source(cfg)
+{
+	update();
+}
+
+shm_source::~shm_source()
+{
+	detach();
+}
+
+void shm_source::update()
+{
+	const std::string &name = m_cfg->shm_name;
+	if (name != m_name) {
+		detach();
+		m_name = name;
+		m_warned = false;
+	}
+
+	if (!m_header)
+		attach();
+
+	/* The writer decides the sample rate */
+	if (m_header && m_header->sample_rate != m_cfg->sample_rate) {
+		m_cfg->sample_rate = m_header->sample_rate;
+		m_cfg->sample_size = m_cfg->sample_rate / UTIL_MAX(m_cfg->fps, 1);
+	}
+}
+
+void shm_source::maintain()
+{
+	const uint64_t now = os_gettime_ns();
+
+	if (!m_header) {
+		if (now - m_attach_check_time < ATTACH_RETRY_NS || !attach())
+			return;
+		/* The buffers are sized for the configured rate until the next update */
+		if (m_header->sample_rate != m_cfg->sample_rate)
+			warn("Shared memory '%s' is at %u Hz instead of %u Hz, reload the source to match", m_name.c_str(),
+				 m_header->sample_rate, m_cfg->sample_rate);
+		return;
+	}
+
+	const uint64_t written = m_header->write_index.load(std::memory_order_acquire);
+	if (written != m_read_index) {
+		m_read_index = written;
+		m_last_progress = now;
+	} else if (now - m_last_progress > STALL_TIMEOUT_NS) {
+		/* If the writer stays away it was probably restarted with a new segment */
+		debug("Writer of shared memory '%s' stalled, reattaching", m_name.c_str());
+		detach();
+	}
+}
+
+bool shm_source::tick(float seconds)
+{
+	m_samples = nullptr;
+	maintain();
+
+	const size_t frames = m_cfg->sample_size;
+	const uint64_t written = m_read_index; /* just refreshed by maintain() */
+	const uint64_t now = os_gettime_ns();
+
+	/* Writers usually work in blocks that don't line up with our ticks, so the
+	 * last window is shown again until the writer has been quiet for a while */
+	if (!m_header || written < frames || now - m_last_progress > IDLE_NS) {
+		memset(m_cfg->buffer, 0, sizeof(float_stereo_sample) * frames);
+		return false;
+	}
+
+	/* Ticks further apart than a window skip frames. Longer gaps are sleeping
+	 * visualizers or a new writer, which don't count */
+	if (now - m_window_time < IDLE_NS && written >= m_window_index && written - m_window_index > frames)
+		m_skipped += written - m_window_index - frames;
+	m_window_index = written;
+	m_window_time = now;
+
+	/* Always the newest window, older frames are simply never looked at */
+	const size_t mask = m_header->capacity - 1;
+	const size_t first = static_cast<size_t>(written - frames) & mask;
+
+	if (m_header->format == shm::SF_F32 && m_header->channels == 2 && first + frames <= m_header->capacity) {
+		m_samples = reinterpret_cast<const float_stereo_sample *>(m_data) + first;
+		return true;
+	}
+
+	const bool stereo = m_header->channels > 1;
+	if (m_header->format == shm::SF_F32) {
+		auto *in = reinterpret_cast<const float *>(m_data);
+		for (size_t i = 0; i < frames; i++) {
+			const size_t pos = ((first + i) & mask) * m_header->channels;
+			m_cfg->buffer[i].l = in[pos];
+			m_cfg->buffer[i].r = stereo ? in[pos + 1] : 0.f;
+		}
+	} else {
+		auto *in = reinterpret_cast<const int16_t *>(m_data);
+		const float scale = 1.f / static_cast<float>(constants::sample_scale);
+		for (size_t i = 0; i < frames; i++) {
+			const size_t pos = ((first + i) & mask) * m_header->channels;
+			m_cfg->buffer[i].l = in[pos] * scale;
+			m_cfg->buffer[i].r = stereo ? in[pos + 1] * scale : 0.f;
+		}
+	}
+	return true;
+}
+
+float shm_source::take_peak()
+{
+	/* There's no thread of our own that sees the samples arrive, so the ones
+	 * written since the last call are scanned here. Still far cheaper than an fft */
+	if (!m_header)
+		return 0.f;
+
+	const uint64_t written = m_header->write_index.load(std::memory_order_acquire);
+	const uint64_t count = std::min<uint64_t>(written - std::min(m_peak_index, written), m_header->capacity);
+	m_peak_index = written;
+
+	const size_t mask = m_header->capacity - 1;
+	const size_t samples = static_cast<size_t>(count) * m_header->channels;
+	const size_t first = (static_cast<size_t>(written - count) & mask) * m_header->channels;
+	const size_t total = static_cast<size_t>(m_header->capacity) * m_header->channels;
+	float peak = 0.f;
+
+	if (m_header->format == shm::SF_F32) {
+		auto *in = reinterpret_cast<const float *>(m_data);
+		for (size_t i = 0; i < samples; i++)
+			peak = std::max(peak, std::fabs(in[(first + i) % total]));
+	} else {
+		auto *in = reinterpret_cast<const int16_t *>(m_data);
+		int max = 0;
+		for (size_t i = 0; i < samples; i++)
+			max = std::max(max, std::abs(int(in[(first + i) % total])));
+		peak = max / static_cast<float>(constants::sample_scale);
+	}
+	return peak;
+}
+
+bool shm_source::attach()
+{
+	m_attach_check_time = os_gettime_ns();
+	if (m_name.empty())
+		return false;
+
+	int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		if (!m_warned)
+			warn("Failed to open shared memory '%s': %s", m_name.c_str(), strerror(errno));
+		m_warned = true;
+		return false;
+	}
+
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= shm::data_offset)
+		map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); /* the mapping stays valid */
+
+	if (map == MAP_FAILED) {
+		if (!m_warned)
+			warn("Failed to map shared memory '%s'", m_name.c_str());
+		m_warned = true;
+		return false;
+	}
+
+	auto *h = static_cast<const shm::header *>(map);
+	const bool valid = h->magic == shm::magic && h->version == shm::version && h->sample_rate > 0 &&
+					   (h->channels == 1 || h->channels == 2) &&
+					   (h->format == shm::SF_S16 || h->format == shm::SF_F32) && h->capacity > 0 &&
+					   (h->capacity & (h->capacity - 1)) == 0 &&
+					   shm::region_size(h->capacity, h->channels, h->format) <= static_cast<size_t>(st.st_size);
+	if (!valid) {
+		if (!m_warned)
+			warn("Shared memory '%s' doesn't contain a valid audio ring", m_name.c_str());
+		m_warned = true;
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	m_map = map;
+	m_map_size = st.st_size;
+	m_header = h;
+	m_data = static_cast<const uint8_t *>(map) + shm::data_offset;
+	m_read_index = m_peak_index = h->write_index.load(std::memory_order_acquire);
+	m_last_progress = os_gettime_ns();
+	m_warned = false;
+	info("Attached to shared memory '%s' (%u Hz, %u channels, %s)", m_name.c_str(), h->sample_rate, h->channels,
+		 h->format == shm::SF_F32 ? "float" : "int16");
+	return true;
+}
+
+void shm_source::detach()
+{
+	if (m_map)
+		munmap(m_map, m_map_size);
+	m_map = nullptr;
+	m_map_size = 0;
+	m_header = nullptr;
+	m_data = nullptr;
+	m_samples = nullptr;
+}
+} /* namespace audio */
+#endif /* LINUX */
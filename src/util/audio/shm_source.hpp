@@ -0,0 +1,75 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "../util.hpp"
+#include "audio_source.hpp"
+#include "shm_ring.hpp"
+#include <string>
+
+namespace audio {
+
+/* Reads audio from a shared memory ring written by a local process (see shm_ring.hpp).
+ * Stereo float data is analyzed in place, other formats are converted */
+class shm_source : public audio_source {
+#ifdef LINUX
+	std::string m_name;
+	void *m_map = nullptr;
+	size_t m_map_size = 0;
+	const shm::header *m_header = nullptr;
+	const uint8_t *m_data = nullptr;
+
+	uint64_t m_read_index = 0;      /* write index at the last tick */
+	uint64_t m_peak_index = 0;      /* write index at the last take_peak() */
+	uint64_t m_last_progress = 0;   /* when the writer last moved on */
+	uint64_t m_attach_check_time = 0;
+	uint64_t m_window_index = 0;    /* write index at the end of the last window handed out */
+	uint64_t m_window_time = 0;     /* and when that was */
+	uint64_t m_skipped = 0;         /* frames between two windows that were never analyzed */
+	bool m_warned = false;
+	const float_stereo_sample *m_samples = nullptr;
+
+	bool attach();
+	void detach();
+
+public:
+	shm_source(source::config *cfg);
+	~shm_source() override;
+	void update() override;
+	bool tick(float seconds) override;
+	void maintain() override;
+	const float_stereo_sample *samples() const override { return m_samples; }
+	float take_peak() override;
+
+	/* The newest window is always read, so nothing queues up, frames can only be skipped */
+	bool queue_state(uint64_t *frames_queued, uint64_t *frames_dropped) const override
+	{
+		*frames_queued = 0;
+		*frames_dropped = m_skipped;
+		return true;
+	}
+#else /* Stubs on Windows */
+public:
+	shm_source(source::config *cfg) : audio_source(cfg) {}
+	~shm_source() override {}
+	void update() override {}
+	bool tick(float seconds) override { return false; }
+#endif /* Linux */
+};
+
+}
@@ -23,197 +23,246 @@
 namespace audio {
 wire_visualizer::wire_visualizer(source::config *cfg) : spectrum_visualizer(cfg) {}
 
-gs_vertbuffer_t *wire_visualizer::make_thin(channel_mode cm)
+wire_visualizer::~wire_visualizer()
 {
-	gs_render_start(true);
+	/* The source deletes visualizers inside the graphics context */
+	destroy_buffers();
+}
+
+size_t wire_visualizer::make_thin(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+								  struct vec3 *points) const
+{
+	size_t n = 0;
 	size_t i = 0, pos_x = 0;
 	int32_t height = 0;
 	int32_t offset = 0;
 	int32_t center = 0;
 
 	if (cm != CM_BOTH) {
-		offset = m_cfg->stereo_space / 2;
-		center = m_cfg->bar_height / 2 + offset;
+		offset = cfg.stereo_space / 2;
+		center = cfg.bar_height / 2 + offset;
 	}
 
 	if (cm == CM_RIGHT) {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_right[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, center + offset + height);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, center + offset + height, 0);
 		}
 	} else if (cm == CM_LEFT) {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_left[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, center - offset - height);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, center - offset - height, 0);
 		}
 	} else {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_left[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, m_cfg->bar_height - height);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, cfg.bar_height - height, 0);
 		}
 	}
 
-	return gs_render_save();
+	return n;
 }
 
-gs_vertbuffer_t *wire_visualizer::make_thick(channel_mode cm)
+size_t wire_visualizer::make_thick(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+								   struct vec3 *points) const
 {
-	gs_render_start(true);
+	size_t n = 0;
 	size_t i = 0, pos_x = 0;
 	int32_t height = 0;
 	int32_t offset = 0;
 	int32_t center = 0;
 
 	if (cm != CM_BOTH) {
-		offset = m_cfg->stereo_space / 2;
-		center = m_cfg->bar_height / 2 + offset;
+		offset = cfg.stereo_space / 2;
+		center = cfg.bar_height / 2 + offset;
 	}
 
 	if (cm == CM_RIGHT) {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_right[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, center + offset + height);
-			gs_vertex2f(pos_x, center + offset + height - m_cfg->wire_thickness);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, center + offset + height, 0);
+			vec3_set(&points[n++], pos_x, center + offset + height - cfg.wire_thickness, 0);
 		}
 	} else if (cm == CM_LEFT) {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_left[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, center - offset - height);
-			gs_vertex2f(pos_x, center - offset - height + m_cfg->wire_thickness);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, center - offset - height, 0);
+			vec3_set(&points[n++], pos_x, center - offset - height + cfg.wire_thickness, 0);
 		}
 	} else {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_left[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, m_cfg->bar_height - height);
-			gs_vertex2f(pos_x, m_cfg->bar_height - height + m_cfg->wire_thickness);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, cfg.bar_height - height, 0);
+			vec3_set(&points[n++], pos_x, cfg.bar_height - height + cfg.wire_thickness, 0);
 		}
 	}
-	return gs_render_save();
+	return n;
 }
 
-gs_vertbuffer_t *wire_visualizer::make_filled(channel_mode cm)
+size_t wire_visualizer::make_filled(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+									struct vec3 *points) const
 {
-
-	gs_render_start(true);
+	size_t n = 0;
 	size_t i = 0, pos_x = 0;
 	int32_t height = 0;
 	int32_t offset = 0;
 	int32_t center = 0;
 
 	if (cm != CM_BOTH) {
-		offset = m_cfg->stereo_space / 2;
-		center = m_cfg->bar_height / 2 + offset;
+		offset = cfg.stereo_space / 2;
+		center = cfg.bar_height / 2 + offset;
 	}
 
 	if (cm == CM_RIGHT) {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_right[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, center + offset + height);
-			gs_vertex2f(pos_x, center + offset);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, center + offset + height, 0);
+			vec3_set(&points[n++], pos_x, center + offset, 0);
 		}
 	} else if (cm == CM_LEFT) {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_left[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, center - offset - height);
-			gs_vertex2f(pos_x, center - offset);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, center - offset - height, 0);
+			vec3_set(&points[n++], pos_x, center - offset, 0);
 		}
 	} else {
-		for (; i < UTIL_MIN(m_cfg->detail + 1, m_bars_right.size()); i++) {
-			auto val = m_bars_left[i];
+		for (; i < UTIL_MIN(max_points, bars.size()); i++) {
+			auto val = bars[i];
 			height = UTIL_MAX(static_cast<int32_t>(round(val)), 1);
 
-			pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-			gs_vertex2f(pos_x, m_cfg->bar_height - height);
-			gs_vertex2f(pos_x, m_cfg->bar_height);
+			pos_x = i * (cfg.bar_width + cfg.bar_space);
+			vec3_set(&points[n++], pos_x, cfg.bar_height - height, 0);
+			vec3_set(&points[n++], pos_x, cfg.bar_height, 0);
 		}
 	}
-	return gs_render_save();
+	return n;
 }
 
-gs_vertbuffer_t *wire_visualizer::make_filled_inverted(channel_mode cm)
+size_t wire_visualizer::make_filled_inverted(const source::settings &cfg, channel_mode cm, const realv &bars,
+											 size_t max_points, struct vec3 *points) const
 {
-	gs_render_start(true);
+	size_t n = 0;
 	size_t i = 0, pos_x = 0;
 	uint32_t height = 0;
-	for (; i < m_bars_left.size() - DEAD_BAR_OFFSET; i++) {
-		auto val = m_bars_left[i];
+	for (; i + DEAD_BAR_OFFSET < bars.size() && i < max_points; i++) {
+		auto val = bars[i];
 		height = UTIL_MAX(static_cast<uint32_t>(round(val)), 1);
 
-		pos_x = i * (m_cfg->bar_width + m_cfg->bar_space);
-		gs_vertex2f(pos_x, m_cfg->bar_height - height);
-		gs_vertex2f(pos_x, 0);
+		pos_x = i * (cfg.bar_width + cfg.bar_space);
+		vec3_set(&points[n++], pos_x, cfg.bar_height - height, 0);
+		vec3_set(&points[n++], pos_x, 0, 0);
+	}
+	return n;
+}
+
+bool wire_visualizer::prepare_buffers(const source::settings &cfg)
+{
+	const bool stereo = cfg.stereo;
+	const auto detail = cfg.detail;
+	const auto mode = cfg.wire_mode;
+	if (m_vertices[0] && m_buffer_detail == detail && m_buffer_mode == mode && m_buffer_stereo == stereo)
+		return true;
+
+	destroy_buffers();
+
+	/* No mode writes more than two vertices per point */
+	const size_t capacity = (detail + 1u) * 2u;
+	for (int i = 0; i < (stereo ? 2 : 1); i++) {
+		struct gs_vb_data *data = gs_vbdata_create();
+		data->num = capacity;
+		data->points = static_cast<struct vec3 *>(bzalloc(sizeof(struct vec3) * capacity));
+		m_vertices[i] = gs_vertexbuffer_create(data, GS_DYNAMIC);
+		if (!m_vertices[i]) {
+			destroy_buffers();
+			return false;
+		}
 	}
-	return gs_render_save();
+
+	m_buffer_detail = detail;
+	m_buffer_mode = mode;
+	m_buffer_stereo = stereo;
+	return true;
 }
 
-void wire_visualizer::render(gs_effect_t *e)
+void wire_visualizer::destroy_buffers()
 {
-	gs_vertbuffer_t *vb_left = nullptr, *vb_right = nullptr;
+	for (auto &vb : m_vertices) {
+		gs_vertexbuffer_destroy(vb);
+		vb = nullptr;
+	}
+}
+
+void wire_visualizer::render(const source::settings &cfg, gs_effect_t *e)
+{
+	const auto &frame = m_frames.front();
 	enum gs_draw_mode m = GS_TRISTRIP;
 	uint32_t num_verts = 0;
-	channel_mode main = m_cfg->stereo ? CM_LEFT : CM_BOTH;
+	channel_mode main = cfg.stereo ? CM_LEFT : CM_BOTH;
+	make_points make = nullptr;
 
-	switch (m_cfg->wire_mode) {
+	switch (cfg.wire_mode) {
 	case WM_THIN:
-		vb_left = make_thin(main);
-		if (m_cfg->stereo)
-			vb_right = make_thin(CM_RIGHT);
+		make = &wire_visualizer::make_thin;
 		m = GS_LINESTRIP;
-		num_verts = m_cfg->detail;
+		num_verts = cfg.detail;
 		break;
 	case WM_THICK:
-		vb_left = make_thick(main);
-		if (m_cfg->stereo)
-			vb_right = make_thick(CM_RIGHT);
-		num_verts = m_cfg->detail * 2;
+		make = &wire_visualizer::make_thick;
+		num_verts = cfg.detail * 2;
 		break;
 	case WM_FILL_INVERTED:
-		vb_left = make_filled_inverted(main);
-		if (m_cfg->stereo)
-			vb_right = make_filled_inverted(CM_RIGHT);
-		num_verts = m_cfg->detail * 2;
+		make = &wire_visualizer::make_filled_inverted;
+		num_verts = cfg.detail * 2;
 		break;
 	case WM_FILL:
-		vb_left = make_filled(CM_RIGHT);
-		if (m_cfg->stereo)
-			vb_right = make_filled(CM_RIGHT);
-		num_verts = m_cfg->detail * 2;
+		make = &wire_visualizer::make_filled;
+		num_verts = cfg.detail * 2;
 		break;
 	}
 
-	gs_load_vertexbuffer(vb_left);
-	gs_draw(m, 0, num_verts);
+	if (!make || !prepare_buffers(cfg))
+		return;
 
-	if (vb_right) {
-		gs_load_vertexbuffer(vb_right);
-		gs_draw(m, 0, num_verts);
-	}
+	const realv *bars[] = {&frame.left, &frame.right};
+	const channel_mode modes[] = {main, CM_RIGHT};
+	for (int i = 0; i < 2 && m_vertices[i]; i++) {
+		/* Bounded by the detail the buffers were made for, since frames
+		 * with the previous bar count can still arrive after a change */
+		auto *points = gs_vertexbuffer_get_data(m_vertices[i])->points;
+		const auto written = (this->*make)(cfg, modes[i], *bars[i], m_buffer_detail + 1u, points);
+		const auto count = UTIL_MIN(static_cast<size_t>(num_verts), written);
+		if (count == 0)
+			continue;
 
-	gs_vertexbuffer_destroy(vb_left);
-	gs_vertexbuffer_destroy(vb_right);
+		gs_vertexbuffer_flush(m_vertices[i]);
+		gs_load_vertexbuffer(m_vertices[i]);
+		gs_draw(m, 0, static_cast<uint32_t>(count));
+	}
+	gs_load_vertexbuffer(nullptr);
+	UNUSED_PARAMETER(e);
 }
 }
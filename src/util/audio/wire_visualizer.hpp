@@ -21,14 +21,32 @@
 
 namespace audio {
 class wire_visualizer : public spectrum_visualizer {
-	gs_vertbuffer_t *make_thin(channel_mode cm);
-	gs_vertbuffer_t *make_thick(channel_mode cm);
-	gs_vertbuffer_t *make_filled(channel_mode cm);
-	gs_vertbuffer_t *make_filled_inverted(channel_mode cm);
+	/* One buffer per channel, filled in place every frame and only
+	 * recreated if detail, wire mode or stereo change */
+	gs_vertbuffer_t *m_vertices[2] = {nullptr, nullptr};
+	uint16_t m_buffer_detail = 0;
+	wire_mode m_buffer_mode = WM_THIN;
+	bool m_buffer_stereo = false;
+
+	bool prepare_buffers(const source::settings &cfg);
+	void destroy_buffers();
+
+	/* Write at most two vertices per point into points and return the vertex count */
+	using make_points = size_t (wire_visualizer::*)(const source::settings &, channel_mode, const realv &, size_t,
+													struct vec3 *) const;
+	size_t make_thin(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+					 struct vec3 *points) const;
+	size_t make_thick(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+					  struct vec3 *points) const;
+	size_t make_filled(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+					   struct vec3 *points) const;
+	size_t make_filled_inverted(const source::settings &cfg, channel_mode cm, const realv &bars, size_t max_points,
+								struct vec3 *points) const;
 
 public:
 	explicit wire_visualizer(source::config *cfg);
+	~wire_visualizer() override;
 
-	void render(gs_effect_t *e) override;
+	void render(const source::settings &cfg, gs_effect_t *e) override;
 };
 }
@@ -0,0 +1,137 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace util {
+
+/* Fixed-capacity window over the most recent values, once full every push
+ * drops the oldest value. Sum and sum of squares are kept up to date on
+ * every push, as is the sum of the oldest head_size() values, so none of
+ * the statistics need a pass over the window. The sums are rebuilt from
+ * scratch once per capacity pushes so rounding errors can't pile up */
+class moving_window {
+	std::vector<double> m_data;
+	size_t m_first = 0; /* index of the oldest value */
+	size_t m_size = 0;
+	size_t m_head_size = 0;
+	size_t m_pushes_since_sync = 0;
+
+	double m_sum = 0, m_sum_squares = 0, m_head_sum = 0;
+
+	double &at(size_t i) { return m_data[(m_first + i) % m_data.size()]; }
+
+	void sync()
+	{
+		m_sum = m_sum_squares = m_head_sum = 0;
+		for (size_t i = 0; i < m_size; i++) {
+			const auto v = at(i);
+			m_sum += v;
+			m_sum_squares += v * v;
+			if (i < m_head_size)
+				m_head_sum += v;
+		}
+		m_pushes_since_sync = 0;
+	}
+
+public:
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_data.size(); }
+	size_t head_size() const { return m_head_size; }
+
+	/* Keeps the newest values that still fit */
+	void resize(size_t capacity, size_t head_size)
+	{
+		if (capacity == m_data.size() && head_size == m_head_size)
+			return;
+
+		std::vector<double> data(capacity);
+		const auto keep = m_size < capacity ? m_size : capacity;
+		for (size_t i = 0; i < keep; i++)
+			data[i] = at(m_size - keep + i);
+
+		m_data.swap(data);
+		m_first = 0;
+		m_size = keep;
+		m_head_size = head_size;
+		sync();
+	}
+
+	void push(double value)
+	{
+		if (m_data.empty())
+			return;
+
+		if (m_size == m_data.size()) {
+			const auto oldest = at(0);
+			m_sum -= oldest;
+			m_sum_squares -= oldest * oldest;
+			if (m_head_size > 0) {
+				m_head_sum -= oldest;
+				/* The value after the old head now belongs to it */
+				if (m_head_size < m_size)
+					m_head_sum += at(m_head_size);
+			}
+			m_first = (m_first + 1) % m_data.size();
+			m_size--;
+		}
+
+		at(m_size) = value;
+		m_size++;
+		m_sum += value;
+		m_sum_squares += value * value;
+		if (m_size <= m_head_size)
+			m_head_sum += value;
+
+		if (++m_pushes_since_sync >= m_data.size())
+			sync();
+	}
+
+	/* Throws away the oldest count values */
+	void drop_oldest(size_t count)
+	{
+		if (count > m_size)
+			count = m_size;
+		if (m_data.empty() || count == 0)
+			return;
+		m_first = (m_first + count) % m_data.size();
+		m_size -= count;
+		sync();
+	}
+
+	double mean() const { return m_size ? m_sum / m_size : 0; }
+
+	/* Population standard deviation, clamped since rounding can push
+	 * the variance slightly below zero */
+	double std_dev() const
+	{
+		if (!m_size)
+			return 0;
+		const auto m = mean();
+		const auto variance = m_sum_squares / m_size - m * m;
+		return variance > 0 ? std::sqrt(variance) : 0;
+	}
+
+	/* Sum of the oldest head_size() values, or of all of them if there are fewer */
+	double head_sum() const { return m_head_sum; }
+};
+
+}
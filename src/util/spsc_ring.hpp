@@ -0,0 +1,121 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+
+/* Wait-free ring buffer for exactly one producer and one consumer thread.
+ * Overflow policy: if the consumer falls behind, the producer drops whatever
+ * doesn't fit (counted in overflowed()). The consumer can throw away stale
+ * items with skip() to keep latency bounded (counted in skipped()) */
+template<class T> class spsc_ring {
+	std::vector<T> m_data;
+	size_t m_mask;
+
+	/* Kept on separate cache lines, since they're written by different threads */
+	alignas(64) std::atomic<size_t> m_head{0}; /* next write position, moved by the producer */
+	alignas(64) std::atomic<size_t> m_tail{0}; /* next read position, moved by the consumer */
+	alignas(64) std::atomic<uint64_t> m_overflowed{0};
+	std::atomic<uint64_t> m_skipped{0};
+
+public:
+	/* Capacity is rounded up to the next power of two */
+	explicit spsc_ring(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		m_data.resize(size);
+		m_mask = size - 1;
+	}
+
+	size_t capacity() const { return m_data.size(); }
+
+	/* Number of items the consumer can read right now */
+	size_t size() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+	/* Items pushed and consumed since the start, positions in this count
+	 * let one side tell where a certain item ended up */
+	size_t pushed() const { return m_head.load(std::memory_order_relaxed); }
+	size_t consumed() const { return m_tail.load(std::memory_order_relaxed); }
+
+	uint64_t overflowed() const { return m_overflowed.load(std::memory_order_relaxed); }
+	uint64_t skipped() const { return m_skipped.load(std::memory_order_relaxed); }
+
+	/* Producer side, fill(T &item, size_t index) is called for every
+	 * item that fits. Returns the number of items that were written */
+	template<class F> size_t push(size_t count, F fill)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		const size_t free = capacity() - (head - m_tail.load(std::memory_order_acquire));
+		const size_t n = count < free ? count : free;
+
+		for (size_t i = 0; i < n; i++)
+			fill(m_data[(head + i) & m_mask], i);
+
+		if (n < count)
+			m_overflowed.fetch_add(count - n, std::memory_order_relaxed);
+		m_head.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+	/* Consumer side, returns the number of items that were read */
+	size_t pop(T *out, size_t count)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		const size_t available = m_head.load(std::memory_order_acquire) - tail;
+		const size_t n = count < available ? count : available;
+
+		for (size_t i = 0; i < n; i++)
+			out[i] = m_data[(tail + i) & m_mask];
+
+		m_tail.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+	/* Consumer side, the oldest item without reading it, nullptr if there's none */
+	const T *front() const
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (m_head.load(std::memory_order_acquire) == tail)
+			return nullptr;
+		return &m_data[tail & m_mask];
+	}
+
+	/* Drops up to count of the oldest items */
+	size_t skip(size_t count)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		const size_t available = m_head.load(std::memory_order_acquire) - tail;
+		const size_t n = count < available ? count : available;
+
+		m_skipped.fetch_add(n, std::memory_order_relaxed);
+		m_tail.store(tail + n, std::memory_order_release);
+		return n;
+	}
+};
+
+}
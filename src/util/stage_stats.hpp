@@ -0,0 +1,277 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <util/platform.h>
+
+namespace util {
+
+/* Lock-free histogram of durations in nanoseconds. There are eight buckets per
+ * power of two, so percentiles are within about 6% of the real value. Any
+ * thread can record or read at any time, reads during a reset may be a bit off */
+class histogram {
+	static const int sub_bits = 3;
+	static const int bucket_count = (32 - sub_bits + 1) << sub_bits; /* up to ~4.3 s */
+
+	std::atomic<uint32_t> m_buckets[bucket_count];
+	std::atomic<uint64_t> m_count{0}, m_max{0};
+
+	static int bucket(uint64_t ns)
+	{
+		if (ns >= (1ull << 32))
+			return bucket_count - 1;
+		if (ns < (1u << sub_bits))
+			return static_cast<int>(ns);
+		int msb = 31;
+		while (!(ns & (1ull << msb)))
+			msb--;
+		const auto sub = static_cast<int>(ns >> (msb - sub_bits)) & ((1 << sub_bits) - 1);
+		return ((msb - sub_bits + 1) << sub_bits) + sub;
+	}
+
+	/* Middle of the values that end up in bucket i */
+	static double bucket_value(int i)
+	{
+		if (i < (1 << sub_bits))
+			return i;
+		const int msb = (i >> sub_bits) + sub_bits - 1;
+		const auto width = 1ull << (msb - sub_bits);
+		const auto low = static_cast<uint64_t>((1 << sub_bits) + (i & ((1 << sub_bits) - 1))) << (msb - sub_bits);
+		return low + width / 2.0;
+	}
+
+public:
+	struct summary {
+		uint64_t count;
+		double p50, p95, p99, max; /* nanoseconds */
+	};
+
+	histogram()
+	{
+		for (auto &b : m_buckets)
+			b.store(0, std::memory_order_relaxed);
+	}
+
+	void record(uint64_t ns)
+	{
+		m_buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		auto max = m_max.load(std::memory_order_relaxed);
+		while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+			;
+	}
+
+	void reset()
+	{
+		for (auto &b : m_buckets)
+			b.store(0, std::memory_order_relaxed);
+		m_count.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	summary summarize() const
+	{
+		uint32_t counts[bucket_count];
+		uint64_t total = 0;
+		for (int i = 0; i < bucket_count; i++)
+			total += counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+
+		summary s{total, 0, 0, 0, static_cast<double>(m_max.load(std::memory_order_relaxed))};
+		const double ranks[] = {total * .5, total * .95, total * .99};
+		double *values[] = {&s.p50, &s.p95, &s.p99};
+		uint64_t seen = 0;
+		int r = 0;
+		for (int i = 0; i < bucket_count && r < 3; i++) {
+			seen += counts[i];
+			while (r < 3 && seen > 0 && seen >= ranks[r])
+				*values[r++] = bucket_value(i) < s.max ? bucket_value(i) : s.max;
+		}
+		return s;
+	}
+};
+
+/* Age of the audio behind every drawn frame. Only one thread records, any
+ * thread can read. Jitter is the smoothed difference between consecutive
+ * frames, the same estimator RTP uses for interarrival jitter */
+class latency_tracker {
+	std::atomic<uint64_t> m_count{0}, m_current{0}, m_min{UINT64_MAX}, m_max{0}, m_jitter{0};
+	double m_jitter_avg = 0; /* recording thread only */
+
+public:
+	struct summary {
+		uint64_t count, current, min, max, jitter; /* nanoseconds */
+	};
+
+	void record(uint64_t ns)
+	{
+		/* Zero if there's no previous frame, or a reset just happened */
+		const auto prev = m_current.load(std::memory_order_relaxed);
+		if (m_count.load(std::memory_order_relaxed) && prev) {
+			const double diff = ns > prev ? ns - prev : prev - ns;
+			m_jitter_avg += (diff - m_jitter_avg) / 16;
+		} else {
+			m_jitter_avg = 0;
+		}
+		m_jitter.store(static_cast<uint64_t>(m_jitter_avg), std::memory_order_relaxed);
+		m_current.store(ns, std::memory_order_relaxed);
+		if (ns < m_min.load(std::memory_order_relaxed))
+			m_min.store(ns, std::memory_order_relaxed);
+		if (ns > m_max.load(std::memory_order_relaxed))
+			m_max.store(ns, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/* m_jitter_avg belongs to the recording thread, which starts it over once it sees the count at zero */
+	void reset()
+	{
+		m_count.store(0, std::memory_order_relaxed);
+		m_current.store(0, std::memory_order_relaxed);
+		m_min.store(UINT64_MAX, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+		m_jitter.store(0, std::memory_order_relaxed);
+	}
+
+	summary summarize() const
+	{
+		return {m_count.load(std::memory_order_relaxed), m_current.load(std::memory_order_relaxed),
+				m_min.load(std::memory_order_relaxed), m_max.load(std::memory_order_relaxed),
+				m_jitter.load(std::memory_order_relaxed)};
+	}
+};
+
+/* Capture queue of sources that buffer audio on their own. Only one thread
+ * records, any thread can read */
+class queue_tracker {
+	std::atomic<uint64_t> m_count{0}, m_queued{0}, m_max{0}, m_dropped{0};
+	uint64_t m_last_total = 0; /* recording thread only */
+
+public:
+	struct summary {
+		uint64_t count, queued, max, dropped; /* frames */
+	};
+
+	/* dropped is the source's running total, only the increase is counted */
+	void record(uint64_t queued, uint64_t dropped)
+	{
+		/* A recreated source starts counting from zero again */
+		m_dropped.fetch_add(dropped >= m_last_total ? dropped - m_last_total : dropped, std::memory_order_relaxed);
+		m_last_total = dropped;
+		m_queued.store(queued, std::memory_order_relaxed);
+		if (queued > m_max.load(std::memory_order_relaxed))
+			m_max.store(queued, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void reset()
+	{
+		m_count.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+		m_dropped.store(0, std::memory_order_relaxed);
+	}
+
+	summary summarize() const
+	{
+		return {m_count.load(std::memory_order_relaxed), m_queued.load(std::memory_order_relaxed),
+				m_max.load(std::memory_order_relaxed), m_dropped.load(std::memory_order_relaxed)};
+	}
+};
+
+enum stage { ST_CAPTURE, ST_CONVERT, ST_FFT, ST_BARS, ST_SMOOTH, ST_SCALE, ST_FALLOFF, ST_RENDER, ST_COUNT };
+
+/* Per source timings of every stage a frame goes through */
+class stage_stats {
+	histogram m_stages[ST_COUNT];
+	latency_tracker m_latency;
+	queue_tracker m_queue;
+
+public:
+	void record(stage s, uint64_t ns) { m_stages[s].record(ns); }
+
+	/* From capture of the newest sample to the render that first shows it */
+	void record_latency(uint64_t ns) { m_latency.record(ns); }
+
+	/* Queue depth after the capture and the source's running total of dropped frames */
+	void record_queue(uint64_t queued, uint64_t dropped) { m_queue.record(queued, dropped); }
+
+	void reset()
+	{
+		for (auto &h : m_stages)
+			h.reset();
+		m_latency.reset();
+		m_queue.reset();
+	}
+
+	/* JSON object with count, p50, p95, p99 and max in microseconds for every stage that ran,
+	 * count, current, min, max and jitter of the audio to render latency if it's known
+	 * and the current and max queue depth and dropped frames of sources with a queue */
+	std::string to_json() const
+	{
+		static const char *names[ST_COUNT] = {"capture", "convert", "fft",     "bars",
+											  "smooth",  "scale",   "falloff", "render"};
+		std::string json = "{";
+		char buf[160];
+		for (int i = 0; i < ST_COUNT; i++) {
+			const auto s = m_stages[i].summarize();
+			if (s.count == 0)
+				continue;
+			snprintf(buf, sizeof(buf), "%s\"%s\":{\"count\":%llu,\"p50\":%.1f,\"p95\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+					 json.size() > 1 ? "," : "", names[i], static_cast<unsigned long long>(s.count), s.p50 / 1000,
+					 s.p95 / 1000, s.p99 / 1000, s.max / 1000);
+			json += buf;
+		}
+
+		const auto l = m_latency.summarize();
+		if (l.count) {
+			snprintf(buf, sizeof(buf),
+					 "%s\"latency\":{\"count\":%llu,\"current\":%.1f,\"min\":%.1f,\"max\":%.1f,\"jitter\":%.1f}",
+					 json.size() > 1 ? "," : "", static_cast<unsigned long long>(l.count), l.current / 1000.0,
+					 l.min / 1000.0, l.max / 1000.0, l.jitter / 1000.0);
+			json += buf;
+		}
+
+		const auto q = m_queue.summarize();
+		if (q.count) {
+			snprintf(buf, sizeof(buf), "%s\"queue\":{\"queued\":%llu,\"max\":%llu,\"dropped\":%llu}",
+					 json.size() > 1 ? "," : "", static_cast<unsigned long long>(q.queued),
+					 static_cast<unsigned long long>(q.max), static_cast<unsigned long long>(q.dropped));
+			json += buf;
+		}
+		return json + "}";
+	}
+};
+
+/* Records the time until it goes out of scope, does nothing without stats */
+class stage_timer {
+	stage_stats *m_stats;
+	stage m_stage;
+	uint64_t m_start;
+
+public:
+	stage_timer(stage_stats *stats, stage s) : m_stats(stats), m_stage(s), m_start(stats ? os_gettime_ns() : 0) {}
+	~stage_timer()
+	{
+		if (m_stats)
+			m_stats->record(m_stage, os_gettime_ns() - m_start);
+	}
+};
+
+}
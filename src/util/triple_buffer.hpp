@@ -0,0 +1,55 @@
+/*************************************************************************
+ * This file is part of spectralizer
+ * github.con/univrsal/spectralizer
+ * Copyright 2020 univrsal <universailp@web.de>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace util {
+
+/* Lock-free handoff of snapshots from one writer to one reader. The writer
+ * fills back() and publishes it, the reader calls update() and then reads
+ * front(). Neither side ever waits for the other, the reader simply keeps
+ * the last snapshot until a newer one has been published */
+template<class T> class triple_buffer {
+	static const uint8_t index_mask = 0x3;
+	static const uint8_t dirty_flag = 0x4; /* set if the shared slot wasn't read yet */
+
+	T m_slots[3];
+	std::atomic<uint8_t> m_shared{1};
+	uint8_t m_back = 0, m_front = 2;
+
+public:
+	/* Writer side */
+	T &back() { return m_slots[m_back]; }
+
+	void publish() { m_back = m_shared.exchange(m_back | dirty_flag, std::memory_order_acq_rel) & index_mask; }
+
+	/* Reader side, returns true if a newer snapshot was picked up */
+	bool update()
+	{
+		if (!(m_shared.load(std::memory_order_relaxed) & dirty_flag))
+			return false;
+		m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+
+	const T &front() const { return m_slots[m_front]; }
+};
+
+}
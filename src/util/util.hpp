@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "../dsp/common.hpp"
 #include <obs-module.h>
 #include <vector>
 
@@ -51,6 +52,9 @@
 #define T_AUDIO_SOURCE_NONE             T_("Spectralizer.AudioSource.None")
 #define T_SOURCE_MPD                    T_("Spectralizer.Source.Fifo")
 #define T_FIFO_PATH                     T_("Spectralizer.Source.Fifo.Path")
+#define T_FIFO_LATENCY					T_("Spectralizer.Source.Fifo.Latency")
+#define T_SOURCE_SHM					T_("Spectralizer.Source.Shm")
+#define T_SHM_NAME						T_("Spectralizer.Source.Shm.Name")
 #define T_BAR_WIDTH                     T_("Spectralizer.Bar.Width")
 #define T_BAR_HEIGHT                    T_("Spectralizer.Bar.Height")
 #define T_SAMPLE_RATE                   T_("Spectralizer.SampleRate")
@@ -77,6 +81,14 @@
 #define T_WIRE_MODE_FILL_INVERTED		T_("Spectralizer.Wire.Mode.Fill.Invert")
 #define T_WIRE_MODE						T_("Spectralizer.Wire.Mode")
 #define T_WIRE_THICKNESS				T_("Spectralizer.Wire.Thickness")
+#define T_SILENCE_THRESHOLD				T_("Spectralizer.SilenceThreshold")
+#define T_WINDOW_SIZE					T_("Spectralizer.Window.Size")
+#define T_WINDOW_SIZE_AUTO				T_("Spectralizer.Window.Size.Auto")
+#define T_WINDOW_FUNCTION				T_("Spectralizer.Window.Function")
+#define T_WINDOW_NONE					T_("Spectralizer.Window.None")
+#define T_WINDOW_HANN					T_("Spectralizer.Window.Hann")
+#define T_WINDOW_BLACKMAN				T_("Spectralizer.Window.Blackman")
+#define T_LOG_STATS						T_("Spectralizer.LogStats")
 
 #define S_SOURCE_MODE                   "source_mode"
 #define S_STEREO                        "stereo"
@@ -85,6 +97,8 @@
 #define S_REFRESH_RATE                  "refresh_rate"
 #define S_AUDIO_SOURCE                  "audio_source"
 #define S_FIFO_PATH                     "fifo_path"
+#define S_FIFO_LATENCY					"fifo_latency"
+#define S_SHM_NAME						"shm_name"
 #define S_BAR_WIDTH                     "width"
 #define S_BAR_HEIGHT                    "height"
 #define S_SAMPLE_RATE                   "sample_rate"
@@ -102,6 +116,10 @@
 #define S_SCALE_SIZE					"scale_size"
 #define S_WIRE_MODE						"wire_mode"
 #define S_WIRE_THICKNESS				"wire_thickness"
+#define S_SILENCE_THRESHOLD				"silence_threshold"
+#define S_WINDOW_SIZE					"window_size"
+#define S_WINDOW_FUNCTION				"window_function"
+#define S_LOG_STATS						"log_stats"
 
 enum visual_mode
 {
@@ -113,13 +131,6 @@ enum wire_mode
     WM_THIN, WM_THICK, WM_FILL, WM_FILL_INVERTED
 };
 
-enum smooting_mode
-{
-    SM_NONE = 0,
-    SM_MONSTERCAT,
-    SM_SGS
-};
-
 enum falloff
 {
     FO_NONE = 0,
@@ -127,19 +138,6 @@ enum falloff
     FO_TOP
 };
 
-enum channel_mode
-{
-    CM_LEFT = 0,
-    CM_RIGHT,
-    CM_BOTH
-};
-
-struct stereo_sample_frame
-{
-    int16_t l, r;
-};
-
-using pcm_stereo_sample = struct stereo_sample_frame;
 #define CNST			static const constexpr
 
 namespace defaults {
@@ -174,20 +172,20 @@ namespace defaults {
     CNST wire_mode		wire_mode		= WM_THIN;
 
     CNST char			*fifo_path		= "/tmp/mpd.fifo";
+    CNST uint32_t		fifo_latency	= 50;		/* ms of audio that may queue up */
+    CNST char			*shm_name		= "/spectralizer";
     CNST char			*audio_source	= "none";
 
     CNST bool			use_auto_scale	= true;
     CNST double			scale_boost		= 0.0;
     CNST double			scale_size		= 1.0;
-};
 
-namespace constants {
-    CNST int auto_scale_span 						= 30;
-    CNST double auto_scaling_reset_window			= 0.1;
-    CNST double auto_scaling_erase_percent 			= 0.75;
-    /* Amount of deviation needed between short term and long
-     * term moving max height averages to trigger an autoscaling reset */
-    CNST double deviation_amount_to_reset 			= 1.0;
-}
+    CNST double			silence_threshold = -90.0; /* dBFS */
+
+    CNST uint32_t		window_size		= 0;		/* Same as the sample size */
+    CNST window_function window			= WF_NONE;
+
+    CNST bool			log_stats		= false;
+};
 
 /* clang-format on */